@@ -0,0 +1,264 @@
+#include "blockcache.h"
+#include "chip8.h"
+
+#include <cstring>
+
+static bool EndsBlock(Op op)
+{
+    switch (op)
+    {
+        // Control flow
+        case Op::Op00EE:
+        case Op::Op1NNN:
+        case Op::Op2NNN:
+        case Op::Op3XNN:
+        case Op::Op4XNN:
+        case Op::Op5XY0:
+        case Op::Op9XY0:
+        case Op::OpBNNN:
+        case Op::OpEX9E:
+        case Op::OpEXA1:
+        case Op::OpFX0A:
+        // Memory writes, might modify translated code
+        case Op::OpFX33:
+        case Op::OpFX55:
+        case Op::Unknown:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static bool IsSkip(Op op)
+{
+    switch (op)
+    {
+        case Op::Op3XNN:
+        case Op::Op4XNN:
+        case Op::Op5XY0:
+        case Op::Op9XY0:
+        case Op::OpEX9E:
+        case Op::OpEXA1:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static FusedOp Fuse(const Instruction& first, const Instruction& second)
+{
+    if (IsSkip(first.op) && second.op == Op::Op1NNN) return FusedOp::SkipJump;
+
+    if (first.op == Op::Op7XNN && second.op == Op::Op3XNN) return FusedOp::AddSkipEq;
+    if (first.op == Op::Op7XNN && second.op == Op::Op4XNN) return FusedOp::AddSkipNe;
+    if (first.op == Op::OpFX07 && second.op == Op::Op3XNN) return FusedOp::TimerSkipEq;
+    if (first.op == Op::OpFX07 && second.op == Op::Op4XNN) return FusedOp::TimerSkipNe;
+    if (first.op == Op::Op6XNN && second.op == Op::Op6XNN) return FusedOp::LoadLoad;
+
+    return FusedOp::None;
+}
+
+BlockCache::BlockCache()
+{
+    m_Empty = false;
+    Flush();
+}
+
+unsigned int BlockCache::Run(chip8& cpu, unsigned int opcodes)
+{
+    while (opcodes > 0)
+    {
+        uint16_t pc = cpu.m_State.programCounter;
+        if (pc >= 0x1000)
+            break;
+
+        int32_t index = m_BlockAt[pc];
+        const Block& block = index >= 0 ? m_Blocks[index] : Translate(cpu, pc);
+
+        // Let the caller single step the rest so the opcode count stays exact
+        if (block.instructionCount > opcodes || block.opCount == 0)
+            break;
+
+        // May flush the cache, so block is not touched afterwards
+        opcodes -= Execute(cpu, block);
+    }
+
+    return opcodes;
+}
+
+void BlockCache::Invalidate(uint16_t address, uint16_t length)
+{
+    if (m_Empty)
+        return;
+
+    for (uint32_t i = address; i < (uint32_t)address + length && i < 0x1000; i++)
+    {
+        if (m_CodeMap[i])
+        {
+            Flush();
+            return;
+        }
+    }
+}
+
+void BlockCache::Flush()
+{
+    if (m_Empty)
+        return;
+
+    m_Blocks.clear();
+    m_Ops.clear();
+
+    for (int i = 0; i < 0x1000; i++)
+        m_BlockAt[i] = -1;
+
+    memset(m_CodeMap, 0, sizeof(m_CodeMap));
+
+    m_Empty = true;
+}
+
+const Block& BlockCache::Translate(chip8& cpu, uint16_t address)
+{
+    Block block;
+    block.firstOp = (uint32_t)m_Ops.size();
+    block.opCount = 0;
+    block.instructionCount = 0;
+
+    uint16_t pc = address;
+    uint16_t translated[MAX_BLOCK_INSTRUCTIONS];
+
+    while (block.instructionCount < MAX_BLOCK_INSTRUCTIONS && pc + 1 < (int)sizeof(cpu.m_State.memory))
+    {
+        BlockOp op;
+        op.first = g_DecodeTable[(cpu.m_State.memory[pc] << 8) | cpu.m_State.memory[pc + 1]];
+        op.second = op.first;
+        op.fused = FusedOp::None;
+        op.next = pc + 2;
+
+        m_CodeMap[pc] = m_CodeMap[pc + 1] = 1;
+        translated[block.instructionCount++] = pc;
+
+        // Follow unconditional jumps as long as they do not loop back into this block
+        if (op.first.op == Op::Op1NNN && block.instructionCount < MAX_BLOCK_INSTRUCTIONS && op.first.nnn + 1 < (int)sizeof(cpu.m_State.memory))
+        {
+            bool visited = false;
+            for (int i = 0; i < block.instructionCount && !visited; i++)
+                visited = translated[i] == op.first.nnn;
+
+            if (!visited)
+            {
+                pc = op.first.nnn;
+                continue;
+            }
+        }
+
+        // Try to fuse with the following instruction
+        if ((!EndsBlock(op.first.op) || IsSkip(op.first.op)) && block.instructionCount < MAX_BLOCK_INSTRUCTIONS && op.next + 1 < (int)sizeof(cpu.m_State.memory))
+        {
+            Instruction second = g_DecodeTable[(cpu.m_State.memory[op.next] << 8) | cpu.m_State.memory[op.next + 1]];
+            FusedOp fused = Fuse(op.first, second);
+
+            if (fused != FusedOp::None)
+            {
+                op.second = second;
+                op.fused = fused;
+
+                m_CodeMap[op.next] = m_CodeMap[op.next + 1] = 1;
+                translated[block.instructionCount++] = op.next;
+                op.next += 2;
+            }
+        }
+
+        m_Ops.push_back(op);
+        block.opCount++;
+        pc = op.next;
+
+        if (EndsBlock(op.first.op) || (op.fused != FusedOp::None && EndsBlock(op.second.op)))
+            break;
+    }
+
+    m_Empty = false;
+    m_BlockAt[address] = (int32_t)m_Blocks.size();
+    m_Blocks.push_back(block);
+
+    return m_Blocks.back();
+}
+
+unsigned int BlockCache::Execute(chip8& cpu, const Block& block)
+{
+    uint8_t* V = cpu.m_State.registers;
+    unsigned int executed = block.instructionCount;
+
+    const BlockOp* op = &m_Ops[block.firstOp];
+    const BlockOp* last = op + block.opCount - 1;
+
+    for (;; op++)
+    {
+        // Only the last op of a block reads the program counter,
+        // it has to point past the op the same way getNextOpcode() leaves it
+        if (op == last)
+            cpu.m_State.programCounter = op->next;
+
+        const Instruction& a = op->first;
+        const Instruction& b = op->second;
+
+        switch (op->fused)
+        {
+            case FusedOp::None:
+                // The most common straight-line opcodes skip the call into the core
+                switch (a.op)
+                {
+                    case Op::Op1NNN: cpu.m_State.programCounter = a.nnn; break;
+                    case Op::Op6XNN: V[a.x] = a.nn; break;
+                    case Op::Op7XNN: V[a.x] += a.nn; break;
+                    case Op::Op8XY0: V[a.x] = V[a.y]; break;
+                    case Op::OpANNN: cpu.m_State.addressI = a.nnn; break;
+
+                    default: cpu.Execute(a); break;
+                }
+                break;
+
+            case FusedOp::AddSkipEq:
+                V[a.x] += a.nn;
+                if (V[b.x] == b.nn) cpu.m_State.programCounter += 2;
+                break;
+
+            case FusedOp::AddSkipNe:
+                V[a.x] += a.nn;
+                if (V[b.x] != b.nn) cpu.m_State.programCounter += 2;
+                break;
+
+            case FusedOp::TimerSkipEq:
+                V[a.x] = cpu.m_State.delayTimer;
+                if (V[b.x] == b.nn) cpu.m_State.programCounter += 2;
+                break;
+
+            case FusedOp::TimerSkipNe:
+                V[a.x] = cpu.m_State.delayTimer;
+                if (V[b.x] != b.nn) cpu.m_State.programCounter += 2;
+                break;
+
+            case FusedOp::LoadLoad:
+                V[a.x] = a.nn;
+                V[b.x] = b.nn;
+                break;
+
+            case FusedOp::SkipJump:
+                // The skip decides if the jump runs at all
+                cpu.m_State.programCounter = op->next - 2;
+                cpu.Execute(a);
+                if (cpu.m_State.programCounter == op->next - 2)
+                    cpu.m_State.programCounter = b.nnn;
+                else
+                    executed--;
+                break;
+        }
+
+        if (op == last)
+            break;
+    }
+
+    return executed;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "decoder.h"
+
+/*
+// Basic block translation cache
+//
+// Straight-line runs of guest code are translated once into a list of
+// pre-decoded operations and cached by start address. Common instruction
+// pairs are fused into a single superinstruction. A block ends at the first
+// instruction that changes control flow or writes guest memory, so a write
+// into translated code (FX33 / FX55) can throw the whole cache away before
+// the next block is looked up. Unconditional jumps are followed during
+// translation, so a block can span several straight-line runs.
+*/
+
+class chip8;
+
+enum class FusedOp : uint8_t
+{
+    None,
+    AddSkipEq,      // 7XNN + 3YNN - loop counter
+    AddSkipNe,      // 7XNN + 4YNN - loop counter
+    TimerSkipEq,    // FX07 + 3YNN - delay timer polling
+    TimerSkipNe,    // FX07 + 4YNN - delay timer polling
+    LoadLoad,       // 6XNN + 6YNN
+    SkipJump        // any skip + 1NNN - conditional branch
+};
+
+struct BlockOp
+{
+    Instruction first;
+    Instruction second; // only used by fused ops
+    FusedOp     fused;
+    uint16_t    next;   // address of the instruction following this op
+};
+
+struct Block
+{
+    uint32_t firstOp;
+    uint16_t opCount;
+    uint16_t instructionCount;  // upper bound, a taken SkipJump executes one less
+};
+
+class BlockCache
+{
+public:
+    BlockCache();
+
+    // Runs whole blocks until fewer instructions than the next block holds are left,
+    // returns how many opcodes are still to be executed
+    unsigned int Run(chip8& cpu, unsigned int opcodes);
+
+    void Invalidate(uint16_t address, uint16_t length);
+    void Flush();
+
+private:
+    static const int MAX_BLOCK_INSTRUCTIONS = 64;
+
+    std::vector<Block>   m_Blocks;
+    std::vector<BlockOp> m_Ops;
+
+    int32_t m_BlockAt[0x1000];  // block index per start address, -1 if not translated
+    uint8_t m_CodeMap[0x1000];  // 1 if the byte belongs to a translated block
+    bool    m_Empty;
+
+private:
+    const Block& Translate(chip8& cpu, uint16_t address);
+    unsigned int Execute(chip8& cpu, const Block& block);
+};
@@ -1,23 +1,30 @@
 #include "chip8.h"
+#include "trace.h"
 #include <ctime>
+#include <cstring>
 #include <string>
 
+// Counts an opcode right after getNextOpcode() fetched it, nothing in normal builds
+#ifdef CHIP8_PROFILE
+    #define PROFILE_INSTRUCTION(opcode) m_Profiler.Count(m_State.programCounter - 2, g_DecodeTable[opcode])
+#else
+    #define PROFILE_INSTRUCTION(opcode)
+#endif
+
 chip8::chip8()
 {
-    // Seed - used for rand()
-    srand(time(0));
-
-    // Setup CPU
+    // Setup CPU, also clears the display
     CPUReset();
 
-    // Clear display
-    for (int y = 0; y < 32; y++)
-    {
-        for (int x = 0; x < 64; x++)
-        {
-            m_ScreenData[y][x] = 0;
-        }
-    }
+    // Seed - used for CXNN
+    setSeed((uint32_t)time(0));
+
+    m_Engine = Engine::Decoded;
+
+    m_RomHash = Hash(nullptr, 0);
+    m_RomSize = 0;
+
+    m_Trace = nullptr;
 }
 
 chip8::~chip8()
@@ -26,59 +33,295 @@ chip8::~chip8()
 
 void chip8::KeyPressed(int key)
 {
-    m_KeyState[key] = 1;
+    m_State.keys[key] = 1;
 }
 
 void chip8::KeyReleased(int key)
 {
-    m_KeyState[key] = 0;
+    m_State.keys[key] = 0;
+}
+
+int chip8::KeyIndex(uint8_t value)
+{
+    return value & 0xF;
 }
 
 void chip8::Run()
 {
-    ExecuteOpcode();
+    if (m_Trace)
+    {
+        ExecuteTraced();
+        return;
+    }
+
+    switch (m_Engine)
+    {
+        case Engine::Interpreter: ExecuteOpcode(); break;
+        case Engine::Decoded: ExecuteDecoded(); break;
+        case Engine::BlockCache: ExecuteDecoded(); break;
+        case Engine::Jit: ExecuteDecoded(); break;
+        case Engine::Static: ExecuteDecoded(); break;
+    }
+}
+
+void chip8::Run(unsigned int opcodes)
+{
+    // Tracing looks at every instruction on its own, whatever the engine
+    if (m_Trace)
+    {
+        for (; opcodes > 0; opcodes--)
+            ExecuteTraced();
+        return;
+    }
+
+#ifdef CHIP8_PROFILE
+    // Translated code runs whole blocks per call, the profile needs every instruction
+    if (m_Engine != Engine::Interpreter)
+    {
+        for (; opcodes > 0; opcodes--)
+            ExecuteDecoded();
+        return;
+    }
+#endif
+
+    switch (m_Engine)
+    {
+        case Engine::Interpreter:
+            for (; opcodes > 0; opcodes--)
+                ExecuteOpcode();
+            break;
+
+        case Engine::BlockCache:
+            opcodes = m_BlockCache.Run(*this, opcodes);
+
+            // Whatever did not fit into a whole block is single stepped
+            for (; opcodes > 0; opcodes--)
+                ExecuteDecoded();
+            break;
+
+        case Engine::Jit:
+            opcodes = m_Jit.Run(*this, opcodes);
+
+            for (; opcodes > 0; opcodes--)
+                ExecuteDecoded();
+            break;
+
+        case Engine::Static:
+            opcodes = m_Static.Run(*this, opcodes);
+
+            for (; opcodes > 0; opcodes--)
+                ExecuteDecoded();
+            break;
+
+        case Engine::Decoded:
+            for (; opcodes > 0; opcodes--)
+                ExecuteDecoded();
+            break;
+    }
+}
+
+void chip8::setEngine(Engine engine)
+{
+    m_Engine = engine;
+    m_BlockCache.Flush();
+    m_Jit.Flush();
+
+    if (m_Engine == Engine::Jit && !m_Jit.Available())
+        std::cout << "JIT not available, using the decoded interpreter\n";
+}
+
+chip8::Engine chip8::getEngine()
+{
+    return m_Engine;
+}
+
+chip8::Engine chip8::getActiveEngine()
+{
+#ifdef CHIP8_PROFILE
+    // See Run(), profiling builds step every instruction
+    if (m_Engine != Engine::Interpreter)
+        return Engine::Decoded;
+#endif
+
+    if ((m_Engine == Engine::Jit && !m_Jit.Available()) || (m_Engine == Engine::Static && !m_Static.Available()))
+        return Engine::Decoded;
+
+    return m_Engine;
 }
 
-void chip8::loadRom(std::string fileName)
+bool chip8::EngineFromName(const std::string& name, Engine& engine)
 {
-    std::string rom = "roms/" + fileName + ".ch8";
+    for (int i = 0; i <= (int)Engine::Static; i++)
+    {
+        if (name == EngineName((Engine)i))
+        {
+            engine = (Engine)i;
+            return true;
+        }
+    }
 
+    return false;
+}
+
+const char* chip8::EngineName(Engine engine)
+{
+    switch (engine)
+    {
+        case Engine::Interpreter: return "Interpreter";
+        case Engine::Decoded: return "Decoded";
+        case Engine::BlockCache: return "BlockCache";
+        case Engine::Jit: return "Jit";
+        case Engine::Static: return "Static";
+    }
+
+    return "Unknown";
+}
+
+bool chip8::loadRom(const std::string& fileName)
+{
     FILE *in;
-    if (in = fopen(rom.c_str(), "rb"))
+    if (in = fopen(fileName.c_str(), "rb"))
     {
-        fread(&m_GameMemory[0x200], 0xfff, 1, in);
+        // One byte more than fits, so a rom that is too large is noticed
+        uint8_t data[sizeof(m_State.memory) - 0x200 + 1];
+        size_t size = fread(data, 1, sizeof(data), in);
         fclose(in);
 
+        if (!loadRom(data, size))
+            return false;
+
         printf("Loaded rom successfuly\n");
+        return true;
     }
-    else printf("Could not load rom!\n");
+
+    printf("Could not load rom!\n");
+    return false;
+}
+
+bool chip8::loadRom(const uint8_t* data, size_t size)
+{
+    if (size > sizeof(m_State.memory) - 0x200)
+    {
+        printf("Rom is too large, %d bytes fit\n", (int)(sizeof(m_State.memory) - 0x200));
+        return false;
+    }
+
+    memcpy(&m_State.memory[0x200], data, size);
+
+    m_RomHash = Hash(data, size);
+    m_RomSize = (uint32_t)size;
+
+    m_BlockCache.Flush();
+    m_Jit.Flush();
+
+#ifdef CHIP8_PROFILE
+    m_Profiler.Reset();
+#endif
+
+    if (!m_Static.Load(&m_State.memory[0x200], size) && m_Engine == Engine::Static)
+        printf("No recompiled code for this rom, using the decoded interpreter\n");
+
+    return true;
+}
+
+uint64_t chip8::getRomHash()
+{
+    return m_RomHash;
+}
+
+uint32_t chip8::getRomSize()
+{
+    return m_RomSize;
+}
+
+uint64_t chip8::Hash(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+void chip8::snapshot(chip8State& state)
+{
+    memcpy(&state, &m_State, sizeof(m_State));
+}
+
+void chip8::restore(const chip8State& state)
+{
+    // Only the differing range of memory can hold stale translated code
+    int first = 0;
+    int last = (int)sizeof(m_State.memory) - 1;
+
+    while (first <= last && m_State.memory[first] == state.memory[first])
+        first++;
+    while (last > first && m_State.memory[last] == state.memory[last])
+        last--;
+
+    memcpy(&m_State, &state, sizeof(m_State));
+
+    if (first <= last)
+        MemoryWritten(first, last - first + 1);
+
+#ifdef CHIP8_PROFILE
+    m_Profiler.Resync(m_State.stack, m_State.stackPointer, m_State.memory);
+#endif
+}
+
+void chip8::setTrace(TraceRecorder* trace)
+{
+    m_Trace = trace;
+}
+
+#ifdef CHIP8_PROFILE
+GuestProfiler& chip8::getProfiler()
+{
+    return m_Profiler;
+}
+#endif
+
+void chip8::setSeed(uint32_t seed)
+{
+    // xorshift can not leave an all zero state
+    m_State.randomState = seed ? seed : 0x2545F491;
 }
 
 void chip8::DecreaseTimers()
 {
-    if (m_DelayTimer > 0)
-        m_DelayTimer--;
+    if (m_State.delayTimer > 0)
+        m_State.delayTimer--;
 
-    if (m_Soundtimer > 0)
-        m_Soundtimer--;
+    if (m_State.soundTimer > 0)
+        m_State.soundTimer--;
 
-    //if (m_Soundtimer > 0)
+    //if (m_State.soundTimer > 0)
         // play beep sound
 }
 
 uint8_t chip8::getScreenData(int x, int y)
 {
-    return m_ScreenData[y][x];
+    return (m_State.screen[y] >> (63 - x)) & 1;
+}
+
+const uint64_t* chip8::getScreenRows()
+{
+    return m_State.screen;
 }
 
 uint8_t chip8::getRegister(int index)
 {
-    return m_Registers[index];
+    return m_State.registers[index];
 }
 
 uint8_t chip8::getKeyState(int index)
 {
-    return m_KeyState[index];
+    return m_State.keys[index];
 }
 
 /*
@@ -86,15 +329,128 @@ uint8_t chip8::getKeyState(int index)
 */
 void chip8::CPUReset()
 {
-    m_AdressI = 0;
-    m_ProgramCounter = 0x200; // Game is loaded into 0x200 so the first instruction is there
+    // Registers, memory, stack, keys, timers and screen to 0
+    memset(&m_State, 0, sizeof(m_State));
+
+    m_State.programCounter = 0x200; // Game is loaded into 0x200 so the first instruction is there
+}
+
+uint8_t chip8::Random()
+{
+    // xorshift32
+    m_State.randomState ^= m_State.randomState << 13;
+    m_State.randomState ^= m_State.randomState >> 17;
+    m_State.randomState ^= m_State.randomState << 5;
+
+    return (uint8_t)(m_State.randomState >> 24);
+}
+
+uint16_t chip8::getCurrentOpcode()
+{
+    return getOpcodeAt(m_State.programCounter);
+}
+
+uint32_t chip8::getIdleLoop(Op loop[3])
+{
+#ifdef CHIP8_PROFILE
+    // The profile has to see every opcode
+    return 0;
+#else
+    uint16_t pc = m_State.programCounter;
+    if (m_Trace || pc > 0xFFA)
+        return 0;
+
+    const Instruction& in = g_DecodeTable[getOpcodeAt(pc)];
+
+    switch (in.op)
+    {
+        case Op::OpFX0A:
+            // Steps back onto itself until a key is down
+            for (int i = 0; i < 16; i++)
+            {
+                if (m_State.keys[i] > 0)
+                    return 0;
+            }
+
+            loop[0] = Op::OpFX0A;
+            return 1;
+
+        case Op::Op1NNN:
+            if (in.nnn == pc)
+            {
+                loop[0] = Op::Op1NNN;
+                return 1;
+            }
+
+            if (pc < 4 || in.nnn != pc - 4 || !isTimerPoll(pc - 4))
+                return 0;
+
+            loop[0] = Op::Op1NNN; loop[1] = Op::OpFX07; loop[2] = Op::Op3XNN;
+            return 3;
+
+        case Op::OpFX07:
+            if (!isTimerPoll(pc))
+                return 0;
+
+            loop[0] = Op::OpFX07; loop[1] = Op::Op3XNN; loop[2] = Op::Op1NNN;
+            return 3;
+
+        case Op::Op3XNN:
+            // Leaves the loop if VX is still 0 from before it
+            if (pc < 2 || !isTimerPoll(pc - 2) || m_State.registers[in.x] == 0)
+                return 0;
+
+            loop[0] = Op::Op3XNN; loop[1] = Op::Op1NNN; loop[2] = Op::OpFX07;
+            return 3;
+
+        default:
+            return 0;
+    }
+#endif
+}
+
+bool chip8::isIdle()
+{
+    Op loop[3];
+    return getIdleLoop(loop) > 0;
+}
+
+void chip8::SkipIdle(uint64_t opcodes)
+{
+    Op loop[3];
+    uint32_t length = getIdleLoop(loop);
 
-    memset(m_Registers, 0, sizeof(m_Registers)); // Set registers to 0
-    memset(m_GameMemory, 0, sizeof(m_GameMemory)); // Set Memory to 0
-    memset(m_KeyState, 0, sizeof(m_KeyState)); // Set keyStates
+    // FX0A and a jump to itself leave the state as it is
+    if (length < 3 || opcodes == 0)
+        return;
 
-    m_DelayTimer = 0;
-    m_Soundtimer = 0;
+    // Position in the timer poll, FX07 is at 0
+    uint32_t phase = loop[0] == Op::OpFX07 ? 0 : loop[0] == Op::Op3XNN ? 1 : 2;
+    uint16_t start = m_State.programCounter - 2 * phase;
+
+    // Once an FX07 ran VX holds the delay timer, which does not change before the next tick
+    if (opcodes > (3 - phase) % 3)
+        m_State.registers[m_State.memory[start] & 0xF] = m_State.delayTimer;
+
+    m_State.programCounter = start + 2 * (uint16_t)((phase + opcodes) % 3);
+}
+
+uint16_t chip8::getOpcodeAt(uint16_t address)
+{
+    return (uint16_t)(m_State.memory[address & 0xFFF] << 8 | m_State.memory[(address + 1) & 0xFFF]);
+}
+
+// FX07, 3X00, 1NNN back to the FX07 at start, spinning while the delay timer runs
+bool chip8::isTimerPoll(uint16_t start)
+{
+    if (m_State.delayTimer == 0 || start > 0xFFA)
+        return false;
+
+    uint16_t load = getOpcodeAt(start);
+    uint16_t skip = getOpcodeAt(start + 2);
+    uint16_t jump = getOpcodeAt(start + 4);
+
+    return (load & 0xF0FF) == 0xF007 && skip == (0x3000 | (load & 0x0F00)) && jump == (0x1000 | start);
 }
 
 uint16_t chip8::getNextOpcode()
@@ -105,10 +461,11 @@ uint16_t chip8::getNextOpcode()
     // logical OR operation to add the second memory slot thus resulting in a 2uint8_t opcode
 
     uint16_t result = 0; // opcode
-    result = m_GameMemory[m_ProgramCounter];
+    // Addresses wrap around at the end of the 4K memory
+    result = m_State.memory[m_State.programCounter & 0xFFF];
     result <<= 8; // Shift 8 times left
-    result = result | m_GameMemory[m_ProgramCounter + 1]; // Combine with logical OR, with the next spot in memory
-    m_ProgramCounter += 2; // Move the program counter to the next opcode
+    result = result | m_State.memory[(m_State.programCounter + 1) & 0xFFF]; // Combine with logical OR, with the next spot in memory
+    m_State.programCounter += 2; // Move the program counter to the next opcode
 
     return result;
 }
@@ -126,6 +483,8 @@ void chip8::ExecuteOpcode()
 
     uint16_t opcode = getNextOpcode();
 
+    PROFILE_INSTRUCTION(opcode);
+
     // Decode Opcode
     switch (opcode & 0xF000)
     {
@@ -207,19 +566,172 @@ void chip8::DecodeOpCodeF(uint16_t opcode)
     default: std::cout << "OpcodeF not found!\n"; break;
     }
 }
+void chip8::ExecuteDecoded()
+{
+    uint16_t opcode = getNextOpcode();
+
+    PROFILE_INSTRUCTION(opcode);
+
+    Execute(g_DecodeTable[opcode]);
+}
+
+void chip8::ExecuteTraced()
+{
+    TraceBefore before;
+    memcpy(before.registers, m_State.registers, sizeof(before.registers));
+    before.addressI = m_State.addressI;
+    before.stackPointer = m_State.stackPointer;
+    before.delayTimer = m_State.delayTimer;
+    before.soundTimer = m_State.soundTimer;
+
+    uint16_t pc = m_State.programCounter;
+    uint16_t opcode = getNextOpcode();
+
+    PROFILE_INSTRUCTION(opcode);
+
+    const Instruction& in = g_DecodeTable[opcode];
+
+    // The stack wraps instead of failing, but a ROM that gets there is broken
+    TraceFault fault = TraceFault::None;
+    if (in.op == Op::Unknown)
+        fault = TraceFault::UnknownOpcode;
+    else if (in.op == Op::Op2NNN && m_State.stackPointer >= 16)
+        fault = TraceFault::StackOverflow;
+    else if (in.op == Op::Op00EE && m_State.stackPointer == 0)
+        fault = TraceFault::StackUnderflow;
+
+    Execute(in);
+
+    m_Trace->Record(pc & 0xFFF, opcode, before, m_State, fault);
+}
+
+void chip8::Execute(const Instruction& in)
+{
+    // Same behaviour as the OpcodeXXXX handlers below, but X, Y, N, NN and NNN
+    // were already extracted when the decode table was built
+    switch (in.op)
+    {
+        case Op::Op00E0: memset(m_State.screen, 0, sizeof(m_State.screen)); break;
+
+        case Op::Op00EE:
+            m_State.programCounter = m_State.stack[--m_State.stackPointer & 0xF];
+            break;
+
+        case Op::Op1NNN: m_State.programCounter = in.nnn; break;
+
+        case Op::Op2NNN:
+            m_State.stack[m_State.stackPointer++ & 0xF] = m_State.programCounter;
+            m_State.programCounter = in.nnn;
+            break;
+
+        case Op::Op3XNN: if (m_State.registers[in.x] == in.nn) m_State.programCounter += 2; break;
+        case Op::Op4XNN: if (m_State.registers[in.x] != in.nn) m_State.programCounter += 2; break;
+        case Op::Op5XY0: if (m_State.registers[in.x] == m_State.registers[in.y]) m_State.programCounter += 2; break;
+        case Op::Op6XNN: m_State.registers[in.x] = in.nn; break;
+        case Op::Op7XNN: m_State.registers[in.x] += in.nn; break;
+        case Op::Op8XY0: m_State.registers[in.x] = m_State.registers[in.y]; break;
+        case Op::Op8XY1: m_State.registers[in.x] |= m_State.registers[in.y]; break;
+        case Op::Op8XY2: m_State.registers[in.x] &= m_State.registers[in.y]; break;
+        case Op::Op8XY3: m_State.registers[in.x] ^= m_State.registers[in.y]; break;
+
+        case Op::Op8XY4:
+        {
+            m_State.registers[0xF] = 0;
+
+            uint16_t value = m_State.registers[in.x] + m_State.registers[in.y];
+            if (value > 255)
+                m_State.registers[0xF] = 1;
+
+            m_State.registers[in.x] = m_State.registers[in.x] + m_State.registers[in.y];
+            break;
+        }
+
+        case Op::Op8XY5:
+        {
+            m_State.registers[0xF] = 0;
+
+            uint16_t xval = m_State.registers[in.x];
+            uint16_t yval = m_State.registers[in.y];
+            if (xval > yval)
+                m_State.registers[0xF] = 1;
+
+            m_State.registers[in.x] = xval - yval;
+            break;
+        }
+
+        case Op::Op8XY6:
+            m_State.registers[0xF] = m_State.registers[in.x] & 0x1;
+            m_State.registers[in.x] >>= 1;
+            break;
+
+        case Op::Op8XY7:
+        {
+            m_State.registers[0xF] = 0;
+
+            uint16_t xval = m_State.registers[in.x];
+            uint16_t yval = m_State.registers[in.y];
+            if (xval < yval)
+                m_State.registers[0xF] = 1;
+
+            m_State.registers[in.x] = yval - xval;
+            break;
+        }
+
+        case Op::Op8XYE:
+            m_State.registers[0xF] = m_State.registers[in.x] >> 7;
+            m_State.registers[in.x] <<= 1;
+            break;
+
+        case Op::Op9XY0: if (m_State.registers[in.x] != m_State.registers[in.y]) m_State.programCounter += 2; break;
+        case Op::OpANNN: m_State.addressI = in.nnn; break;
+        case Op::OpBNNN: m_State.programCounter = in.nnn + m_State.registers[0]; break;
+        case Op::OpCXNN: m_State.registers[in.x] = in.nn & Random(); break;
+
+        // Drawing and the memory block operations are not decode bound
+        case Op::OpDXYN: OpcodeDXYN(0xD000 | (in.x << 8) | (in.y << 4) | in.n); break;
+
+        case Op::OpEX9E: if (m_State.keys[KeyIndex(m_State.registers[in.x])] == 1) m_State.programCounter += 2; break;
+        case Op::OpEXA1: if (m_State.keys[KeyIndex(m_State.registers[in.x])] == 0) m_State.programCounter += 2; break;
+        case Op::OpFX07: m_State.registers[in.x] = m_State.delayTimer; break;
+        case Op::OpFX0A: OpcodeFX0A(0xF00A | (in.x << 8)); break;
+        case Op::OpFX15: m_State.delayTimer = m_State.registers[in.x]; break;
+        case Op::OpFX18: m_State.soundTimer = m_State.registers[in.x]; break;
+        case Op::OpFX1E: m_State.addressI = m_State.addressI + m_State.registers[in.x]; break;
+        case Op::OpFX29: m_State.addressI = m_State.registers[in.x] * 5; break;
+        case Op::OpFX33: OpcodeFX33(0xF033 | (in.x << 8)); break;
+        case Op::OpFX55: OpcodeFX55(0xF055 | (in.x << 8)); break;
+        case Op::OpFX65: OpcodeFX65(0xF065 | (in.x << 8)); break;
+
+        default:
+            std::cout << "Opcode" << std::hex << std::uppercase << (int)in.group << " not found!\n" << std::dec;
+            break;
+    }
+}
+
+void chip8::MemoryWritten(uint16_t address, uint16_t length)
+{
+    address &= 0xFFF;
+
+    // Writes wrap around at the end of memory
+    if (address + length > 0x1000)
+    {
+        MemoryWritten(0, address + length - 0x1000);
+        length = 0x1000 - address;
+    }
+
+    // Drop translated code that was just overwritten
+    m_BlockCache.Invalidate(address, length);
+    m_Jit.Invalidate(address, length);
+    m_Static.Invalidate(m_State.memory, address, length);
+}
+
 /*
     OPCODE Definitions
 */
 void chip8::Opcode00E0(uint16_t opcode)
 {
     // Clear display
-    for (int y = 0; y < 32; y++)
-    {
-        for (int x = 0; x < 64; x++)
-        {
-            m_ScreenData[y][x] = 0;
-        }
-    }
+    memset(m_State.screen, 0, sizeof(m_State.screen));
 
     #ifdef DEBUG
         std::cout << "Clear Screen\n";
@@ -229,19 +741,19 @@ void chip8::Opcode00E0(uint16_t opcode)
 
 void chip8::Opcode00EE(uint16_t opcode)
 {
-    m_ProgramCounter = m_stack.top();
-    m_stack.pop();
+    // The 16 entry stack wraps around instead of overflowing
+    m_State.programCounter = m_State.stack[--m_State.stackPointer & 0xF];
 }
 
 void chip8::Opcode1NNN(uint16_t opcode)
 {
-    m_ProgramCounter = opcode & 0x0FFF;
+    m_State.programCounter = opcode & 0x0FFF;
 }
 
 void chip8::Opcode2NNN(uint16_t opcode)
 {
-    m_stack.push(m_ProgramCounter);
-    m_ProgramCounter = opcode & 0x0FFF;
+    m_State.stack[m_State.stackPointer++ & 0xF] = m_State.programCounter;
+    m_State.programCounter = opcode & 0x0FFF;
 }
 
 void chip8::Opcode3XNN(uint16_t opcode)
@@ -250,8 +762,8 @@ void chip8::Opcode3XNN(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8; // shift jer inace dobimo 0x200, a ako shiftamo dobijemo 0x2, hex znamenku mozemo prikazati pomocu 4 bita znaci da ako hocemo pomaknuti za jedno mjesto znamenku shiftamo 4, a s obzirom da hocemo 2 mjesta pomaknuti shifta se 8
 
-    if (m_Registers[regx] == nn)
-        m_ProgramCounter += 2;
+    if (m_State.registers[regx] == nn)
+        m_State.programCounter += 2;
 }
 
 void chip8::Opcode4XNN(uint16_t opcode)
@@ -260,8 +772,8 @@ void chip8::Opcode4XNN(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    if (m_Registers[regx] != nn)
-        m_ProgramCounter += 2;
+    if (m_State.registers[regx] != nn)
+        m_State.programCounter += 2;
 }
 
 void chip8::Opcode5XY0(uint16_t opcode)
@@ -271,8 +783,8 @@ void chip8::Opcode5XY0(uint16_t opcode)
     uint16_t regy = opcode & 0x00F0;
     regy >>= 4; // shift 4 jer se dobije 0x20, a trazi se 0x2
 
-    if (m_Registers[regx] == m_Registers[regy])
-        m_ProgramCounter += 2; // skip next instruction
+    if (m_State.registers[regx] == m_State.registers[regy])
+        m_State.programCounter += 2; // skip next instruction
 }
 
 void chip8::Opcode6XNN(uint16_t opcode)
@@ -281,7 +793,7 @@ void chip8::Opcode6XNN(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    m_Registers[regx] = nn;
+    m_State.registers[regx] = nn;
 }
 
 void chip8::Opcode7XNN(uint16_t opcode)
@@ -290,7 +802,7 @@ void chip8::Opcode7XNN(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    m_Registers[regx] += nn;
+    m_State.registers[regx] += nn;
 }
 
 void chip8::Opcode8XY0(uint16_t opcode)
@@ -300,7 +812,7 @@ void chip8::Opcode8XY0(uint16_t opcode)
     uint16_t regy = opcode & 0x00F0;
     regy >>= 4;
 
-    m_Registers[regx] = m_Registers[regy];
+    m_State.registers[regx] = m_State.registers[regy];
 }
 
 void chip8::Opcode8XY1(uint16_t opcode)
@@ -310,7 +822,7 @@ void chip8::Opcode8XY1(uint16_t opcode)
     uint16_t regy = opcode & 0x00F0;
     regy >>= 4;
 
-    m_Registers[regx] = m_Registers[regx] | m_Registers[regy];
+    m_State.registers[regx] = m_State.registers[regx] | m_State.registers[regy];
 }
 
 void chip8::Opcode8XY2(uint16_t opcode)
@@ -320,7 +832,7 @@ void chip8::Opcode8XY2(uint16_t opcode)
     uint16_t regy = opcode & 0x00F0;
     regy >>= 4;
 
-    m_Registers[regx] = m_Registers[regx] & m_Registers[regy];
+    m_State.registers[regx] = m_State.registers[regx] & m_State.registers[regy];
 }
 
 void chip8::Opcode8XY3(uint16_t opcode)
@@ -330,40 +842,40 @@ void chip8::Opcode8XY3(uint16_t opcode)
     uint16_t regy = opcode & 0x00F0;
     regy >>= 4;
 
-    m_Registers[regx] = m_Registers[regx] ^ m_Registers[regy];
+    m_State.registers[regx] = m_State.registers[regx] ^ m_State.registers[regy];
 }
 
 void chip8::Opcode8XY4(uint16_t opcode)
 {
-    m_Registers[0xF] = 0;
+    m_State.registers[0xF] = 0;
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
     uint16_t regy = opcode & 0x00F0;
     regy >>= 4;
 
-    uint16_t value = m_Registers[regx] + m_Registers[regy];
+    uint16_t value = m_State.registers[regx] + m_State.registers[regy];
 
     if (value > 255)
-        m_Registers[0xF] = 1;
+        m_State.registers[0xF] = 1;
 
-    m_Registers[regx] = m_Registers[regx] + m_Registers[regy];
+    m_State.registers[regx] = m_State.registers[regx] + m_State.registers[regy];
 }
 
 void chip8::Opcode8XY5(uint16_t opcode)
 {
-    m_Registers[0xF] = 0;
+    m_State.registers[0xF] = 0;
     uint16_t regx = opcode & 0x0F00; // mask off reg x
     regx = regx >> 8; // shift x across 
     uint16_t regy = opcode & 0x00F0; // mask off reg y 
     regy = regy >> 4; // shift y across 
 
-    uint16_t xval = m_Registers[regx];
-    uint16_t yval = m_Registers[regy];
+    uint16_t xval = m_State.registers[regx];
+    uint16_t yval = m_State.registers[regy];
 
     if (xval > yval) 
-        m_Registers[0xF] = 1;
+        m_State.registers[0xF] = 1;
 
-    m_Registers[regx] = xval - yval;
+    m_State.registers[regx] = xval - yval;
 }
 
 void chip8::Opcode8XY6(uint16_t opcode)
@@ -371,25 +883,25 @@ void chip8::Opcode8XY6(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    m_Registers[0xF] = m_Registers[regx] & 0x1;
-    m_Registers[regx] >>= 1;
+    m_State.registers[0xF] = m_State.registers[regx] & 0x1;
+    m_State.registers[regx] >>= 1;
 }
 
 void chip8::Opcode8XY7(uint16_t opcode)
 {
-    m_Registers[0xF] = 0;
+    m_State.registers[0xF] = 0;
     uint16_t regx = opcode & 0x0F00; // mask off reg x
     regx = regx >> 8; // shift x across 
     uint16_t regy = opcode & 0x00F0; // mask off reg y 
     regy = regy >> 4; // shift y across 
 
-    uint16_t xval = m_Registers[regx];
-    uint16_t yval = m_Registers[regy];
+    uint16_t xval = m_State.registers[regx];
+    uint16_t yval = m_State.registers[regy];
 
     if (xval < yval)
-        m_Registers[0xF] = 1;
+        m_State.registers[0xF] = 1;
 
-    m_Registers[regx] = yval - xval;
+    m_State.registers[regx] = yval - xval;
 }
 
 void chip8::Opcode8XYE(uint16_t opcode)
@@ -397,8 +909,8 @@ void chip8::Opcode8XYE(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    m_Registers[0xF] = m_Registers[regx] >> 7;
-    m_Registers[regx] <<= 1;
+    m_State.registers[0xF] = m_State.registers[regx] >> 7;
+    m_State.registers[regx] <<= 1;
 }
 
 void chip8::Opcode9XY0(uint16_t opcode)
@@ -408,19 +920,19 @@ void chip8::Opcode9XY0(uint16_t opcode)
     uint16_t regy = opcode & 0x00F0;
     regy >>= 4; // shift 4 jer se dobije 0x20, a trazi se 0x2
 
-    if (m_Registers[regx] != m_Registers[regy])
-        m_ProgramCounter += 2; // skip next instruction
+    if (m_State.registers[regx] != m_State.registers[regy])
+        m_State.programCounter += 2; // skip next instruction
 }
 
 void chip8::OpcodeANNN(uint16_t opcode)
 {
-    m_AdressI = opcode & 0x0FFF;
+    m_State.addressI = opcode & 0x0FFF;
 }
 
 void chip8::OpcodeBNNN(uint16_t opcode)
 {
     uint16_t nnn = opcode & 0x0FFF;
-    m_ProgramCounter = nnn + m_Registers[0];
+    m_State.programCounter = nnn + m_State.registers[0];
 }
 
 void chip8::OpcodeCXNN(uint16_t opcode)
@@ -429,7 +941,7 @@ void chip8::OpcodeCXNN(uint16_t opcode)
     regx >>= 8;
     uint16_t nn = opcode & 0x00FF;
 
-    m_Registers[regx] = nn & (rand() % 256);
+    m_State.registers[regx] = nn & Random();
 }
 
 void chip8::OpcodeDXYN(uint16_t opcode)
@@ -442,33 +954,24 @@ void chip8::OpcodeDXYN(uint16_t opcode)
     regy = regy >> 4;
 
     uint16_t height = opcode & 0x000F;
-    uint16_t coordx = m_Registers[regx];
-    uint16_t coordy = m_Registers[regy];
 
-    m_Registers[0xf] = 0;
+    // The start position wraps around, the sprite itself is clipped at the edges
+    uint16_t coordx = m_State.registers[regx] & 63;
+    uint16_t coordy = m_State.registers[regy] & 31;
+
+    uint64_t collision = 0;
 
     // loop for the amount of vertical lines needed to draw
-    for (int yline = 0; yline < height; yline++)
+    for (int yline = 0; yline < height && coordy + yline < 32; yline++)
     {
-        uint8_t data = m_GameMemory[m_AdressI + yline];
-        int xpixelinv = 7;
-        int xpixel = 0;
-
-        for (xpixel = 0; xpixel < 8; xpixel++, xpixelinv--)
-        {
-            int mask = 1 << xpixelinv;
-            if (data & mask)
-            {
-                int x = coordx + xpixel;
-                int y = coordy + yline;
+        // Sprite byte moved into place within the 64 pixel row, bits past x = 63 fall off
+        uint64_t sprite = ((uint64_t)m_State.memory[(m_State.addressI + yline) & 0xFFF] << 56) >> coordx;
 
-                if (m_ScreenData[y][x] == 1)
-                    m_Registers[0xF] = 1; //collision
-
-                m_ScreenData[y][x] ^= 1;
-            }
-        }
+        collision |= m_State.screen[coordy + yline] & sprite;
+        m_State.screen[coordy + yline] ^= sprite;
     }
+
+    m_State.registers[0xF] = collision != 0;
 }
 
 void chip8::OpcodeEX9E(uint16_t opcode)
@@ -477,10 +980,10 @@ void chip8::OpcodeEX9E(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    uint16_t key = m_Registers[regx];
+    int key = KeyIndex(m_State.registers[regx]);
 
-    if (m_KeyState[key] == 1)
-        m_ProgramCounter += 2;
+    if (m_State.keys[key] == 1)
+        m_State.programCounter += 2;
 }
 
 void chip8::OpcodeEXA1(uint16_t opcode)
@@ -489,10 +992,10 @@ void chip8::OpcodeEXA1(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00; // vrati recimo 0x200, ali se trazi 0x2 pa se shifta za 2 znamenke 2 * 4
     regx >>= 8;
 
-    uint16_t key = m_Registers[regx];
+    int key = KeyIndex(m_State.registers[regx]);
 
-    if (m_KeyState[key] == 0)
-        m_ProgramCounter += 2;
+    if (m_State.keys[key] == 0)
+        m_State.programCounter += 2;
 }
 
 void chip8::OpcodeFX07(uint16_t opcode)
@@ -501,7 +1004,7 @@ void chip8::OpcodeFX07(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    m_Registers[regx] = m_DelayTimer;
+    m_State.registers[regx] = m_State.delayTimer;
 }
 
 void chip8::OpcodeFX0A(uint16_t opcode)
@@ -514,7 +1017,7 @@ void chip8::OpcodeFX0A(uint16_t opcode)
 
     for (int i = 0; i < 16; i++)
     {
-        if (m_KeyState[i] > 0)
+        if (m_State.keys[i] > 0)
         {
             keypressed = i;
             break;
@@ -522,9 +1025,9 @@ void chip8::OpcodeFX0A(uint16_t opcode)
     }
 
     if (keypressed == -1)
-        m_ProgramCounter -= 2;
+        m_State.programCounter -= 2;
     else
-        m_Registers[regx] = keypressed;
+        m_State.registers[regx] = keypressed;
 }
 
 void chip8::OpcodeFX15(uint16_t opcode)
@@ -533,16 +1036,16 @@ void chip8::OpcodeFX15(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    m_DelayTimer = m_Registers[regx];
+    m_State.delayTimer = m_State.registers[regx];
 }
 
 void chip8::OpcodeFX18(uint16_t opcode)
 {
     // Sound timer
     uint16_t regx = opcode & 0x0F00;
-    regx >>= 0;
+    regx >>= 8;
 
-    m_Soundtimer = m_Registers[regx];
+    m_State.soundTimer = m_State.registers[regx];
 }
 
 void chip8::OpcodeFX1E(uint16_t opcode)
@@ -550,14 +1053,14 @@ void chip8::OpcodeFX1E(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    m_AdressI = m_AdressI + m_Registers[regx];
+    m_State.addressI = m_State.addressI + m_State.registers[regx];
 }
 
 void chip8::OpcodeFX29(uint16_t opcode)
 {
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
-    m_AdressI = m_Registers[regx] * 5;
+    m_State.addressI = m_State.registers[regx] * 5;
 }
 
 void chip8::OpcodeFX33(uint16_t opcode)
@@ -565,15 +1068,17 @@ void chip8::OpcodeFX33(uint16_t opcode)
     uint16_t regx = opcode & 0x0F00;
     regx >>= 8;
 
-    uint16_t value = m_Registers[regx];
+    uint16_t value = m_State.registers[regx];
 
     uint16_t hundreds = value / 100;
     uint16_t tens = (value / 10) % 10;
     uint16_t units = value % 10;
 
-    m_GameMemory[m_AdressI] = hundreds;
-    m_GameMemory[m_AdressI + 1] = tens;
-    m_GameMemory[m_AdressI + 2] = units;
+    m_State.memory[m_State.addressI & 0xFFF] = hundreds;
+    m_State.memory[(m_State.addressI + 1) & 0xFFF] = tens;
+    m_State.memory[(m_State.addressI + 2) & 0xFFF] = units;
+
+    MemoryWritten(m_State.addressI, 3);
 }
 
 void chip8::OpcodeFX55(uint16_t opcode)
@@ -583,10 +1088,12 @@ void chip8::OpcodeFX55(uint16_t opcode)
 
     for (int i = 0; i <= regx; i++)
     {
-        m_GameMemory[m_AdressI + i] = m_Registers[i];
+        m_State.memory[(m_State.addressI + i) & 0xFFF] = m_State.registers[i];
     }
 
-    m_AdressI = m_AdressI + regx + 1;
+    MemoryWritten(m_State.addressI, regx + 1);
+
+    m_State.addressI = m_State.addressI + regx + 1;
 }
 
 void chip8::OpcodeFX65(uint16_t opcode)
@@ -596,8 +1103,8 @@ void chip8::OpcodeFX65(uint16_t opcode)
 
     for (int i = 0; i <= regx; i++)
     {
-        m_Registers[i] = m_GameMemory[m_AdressI + i];
+        m_State.registers[i] = m_State.memory[(m_State.addressI + i) & 0xFFF];
     }
 
-    m_AdressI = m_AdressI + regx + 1;
+    m_State.addressI = m_State.addressI + regx + 1;
 }
@@ -3,18 +3,63 @@
 
 //#define DEBUG
 
-#include <stack>
 #include <fstream>
 #include <iostream>
 #include <cstdint> // Allows uint8_t
+#include <type_traits>
+
+#include "decoder.h"
+#include "blockcache.h"
+#include "jit.h"
+#include "staticprogram.h"
+
+#ifdef CHIP8_PROFILE
+#include "profiler.h"
+#endif
 
 /*
 // WORD 16-bit
 // BYTE  8-bit
 */
 
+// Everything the guest can observe, in one trivially copyable block so a
+// machine can be saved and restored with a single memcpy
+struct chip8State
+{
+    uint64_t screen[32];        // one bit per pixel, see chip8::getScreenRows
+    uint32_t randomState;       // CXNN generator
+
+    uint16_t addressI;
+    uint16_t programCounter;
+    uint16_t stack[16];
+
+    uint8_t  memory[0x1000];
+    uint8_t  registers[16];
+    uint8_t  keys[16];
+
+    uint8_t  stackPointer;
+    uint8_t  delayTimer;
+    uint8_t  soundTimer;
+    uint8_t  reserved[5];       // no padding, states can be compared and hashed bytewise
+};
+
+class TraceRecorder;
+
+static_assert(std::is_trivially_copyable<chip8State>::value, "chip8State must stay trivially copyable");
+static_assert(std::has_unique_object_representations<chip8State>::value, "chip8State must not contain padding");
+
 class chip8
 {
+public:
+    enum class Engine
+    {
+        Interpreter,    // Reference nested switch decoder
+        Decoded,        // Pre-decoded 64K opcode table
+        BlockCache,     // Cached basic blocks with fused instructions
+        Jit,            // x86-64 recompiler, falls back to Decoded where unavailable
+        Static          // Ahead of time recompiled ROM, falls back to Decoded for unknown ROMs
+    };
+
 public:
     chip8();
     ~chip8();
@@ -22,33 +67,103 @@ public:
     void KeyPressed(int key);
     void KeyReleased(int key);
 
+    // The key EX9E and EXA1 test for a VX, only its low nibble counts so
+    // VX = 0x13 tests key 3. Every engine goes through this
+    static int KeyIndex(uint8_t value);
+
     void Run();
-    void loadRom(std::string fileName);
+    void Run(unsigned int opcodes);
+
+    void setEngine(Engine engine);
+    Engine getEngine();
+
+    // The engine that really runs, Decoded where the selected one is not
+    // available on this host or has no recompiled code for the loaded rom
+    Engine getActiveEngine();
+
+    static bool EngineFromName(const std::string& name, Engine& engine);
+    static const char* EngineName(Engine engine);
+
+    // Loads a rom from a file path or from memory to 0x200,
+    // fails if it does not fit into the 0xE00 bytes above that
+    bool loadRom(const std::string& fileName);
+    bool loadRom(const uint8_t* data, size_t size);
+
+    // Identifies the loaded rom, e.g. for save states
+    uint64_t getRomHash();
+    uint32_t getRomSize();
+
+    // 64-bit FNV-1a
+    static uint64_t Hash(const void* data, size_t size);
+
+    // CXNN uses its own generator so runs can be reproduced
+    void setSeed(uint32_t seed);
 
     void DecreaseTimers();
 
     uint8_t getScreenData(int x, int y);
 
+    // 32 rows of 64 pixels, the most significant bit is x = 0
+    const uint64_t* getScreenRows();
+
     uint8_t getRegister(int index);
+
+    // The opcode at the program counter, the one that runs next
+    uint16_t getCurrentOpcode();
+
+    // Idle loops only burn opcodes until a timer ticks or a key changes:
+    // FX0A waiting for a key, a 1NNN jumping to itself and an FX07, 3X00,
+    // 1NNN loop polling the delay timer. Fills loop with the ops of the loop
+    // the program counter is in, in the order they run from it, and returns
+    // their number, 0 when the guest is doing real work. Always 0 while a
+    // trace is attached and in profiling builds, they see every opcode
+    uint32_t getIdleLoop(Op loop[3]);
+    bool isIdle();
+
+    // Advances the idle loop by that many opcodes without running them, the
+    // state ends up exactly as if they had run. Does nothing outside of one
+    void SkipIdle(uint64_t opcodes);
+
     uint8_t getKeyState(int index);
 
+    // Copies the whole machine state, restore() drops translated code
+    // only where the restored memory differs from the current one
+    void snapshot(chip8State& state);
+    void restore(const chip8State& state);
+
+    // While a recorder is attached every instruction is traced, nullptr detaches
+    void setTrace(TraceRecorder* trace);
+
+#ifdef CHIP8_PROFILE
+    // Counts since the rom was loaded
+    GuestProfiler& getProfiler();
+#endif
+
 private:
-    uint8_t m_GameMemory[0xFFF];
-    uint8_t m_Registers[16];
-    uint16_t m_AdressI;
-    uint16_t m_ProgramCounter;
-    std::stack<uint16_t> m_stack;
+    chip8State m_State;
+
+    Engine m_Engine;
+
+    uint64_t m_RomHash;
+    uint32_t m_RomSize;
 
-    uint8_t m_ScreenData[32][64];
-    uint8_t m_KeyState[16];
+    BlockCache m_BlockCache;
+    Jit m_Jit;
+    StaticRecompiled m_Static;
 
-    uint8_t m_DelayTimer;
-    uint8_t m_Soundtimer;
+    TraceRecorder* m_Trace;
+
+#ifdef CHIP8_PROFILE
+    GuestProfiler m_Profiler;
+#endif
 
 private:
     void CPUReset();
 
     uint16_t getNextOpcode();
+    uint16_t getOpcodeAt(uint16_t address);
+    bool isTimerPoll(uint16_t start);
+    uint8_t Random();
     void ExecuteOpcode();
 
     void DecodeOpcode0(uint16_t opcode);
@@ -56,6 +171,17 @@ private:
     void DecodeOpcodeE(uint16_t opcode);
     void DecodeOpCodeF(uint16_t opcode);
 
+    void ExecuteDecoded();
+    void ExecuteTraced();
+    void Execute(const Instruction& in);
+
+    void MemoryWritten(uint16_t address, uint16_t length);
+
+    friend class BlockCache;
+    friend class Jit;
+    friend class StaticRecompiled;
+    friend class LockstepVerifier;
+
 private:
     // OPCODES
     //void Opcode0NNN(uint16_t opcode); Most roms don't use it
@@ -0,0 +1,753 @@
+#include "chip8batch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// What the vector pass does with a lane, Scalar lanes go through ExecuteLane()
+enum AluKind : uint8_t
+{
+    AluScalar,
+    AluSkipEqual, AluSkipNotEqual,
+    AluLoad, AluAdd, AluOr, AluAnd, AluXor,
+    AluAddCarry, AluSub, AluShiftRight, AluSubReverse, AluShiftLeft
+};
+
+// Set on the kinds whose second operand is NN instead of VY
+static const uint8_t ALU_IMMEDIATE = 0x80;
+
+// AluKind of a decoded opcode
+static inline uint8_t Classify(const Instruction& in)
+{
+    // With VF as an operand the flag write changes the result, those stay scalar
+    bool flagOperand = in.x == 0xF || in.y == 0xF;
+
+    switch (in.op)
+    {
+        case Op::Op3XNN: return AluSkipEqual | ALU_IMMEDIATE;
+        case Op::Op4XNN: return AluSkipNotEqual | ALU_IMMEDIATE;
+        case Op::Op5XY0: return AluSkipEqual;
+        case Op::Op9XY0: return AluSkipNotEqual;
+        case Op::Op6XNN: return AluLoad | ALU_IMMEDIATE;
+        case Op::Op7XNN: return AluAdd | ALU_IMMEDIATE;
+        case Op::Op8XY0: return AluLoad;
+        case Op::Op8XY1: return AluOr;
+        case Op::Op8XY2: return AluAnd;
+        case Op::Op8XY3: return AluXor;
+        case Op::Op8XY4: return flagOperand ? AluScalar : AluAddCarry;
+        case Op::Op8XY5: return flagOperand ? AluScalar : AluSub;
+        case Op::Op8XY6: return in.x == 0xF ? AluScalar : AluShiftRight;
+        case Op::Op8XY7: return flagOperand ? AluScalar : AluSubReverse;
+        case Op::Op8XYE: return in.x == 0xF ? AluScalar : AluShiftLeft;
+        default: return AluScalar;
+    }
+}
+
+// Index of the lowest set bit of a non zero mask
+static inline size_t LowestBit(uint64_t mask)
+{
+#if defined(__GNUC__)
+    return (size_t)__builtin_ctzll(mask);
+#else
+    size_t index = 0;
+    while (!((mask >> index) & 1))
+        index++;
+    return index;
+#endif
+}
+
+// The opcode at address of a 4K memory
+static inline uint16_t OpcodeAt(const uint8_t* memory, uint16_t address)
+{
+    return (uint16_t)(memory[address & 0xFFF] << 8 | memory[(address + 1) & 0xFFF]);
+}
+
+// FX07, 3X00, 1NNN back to the FX07 at start, chip8::isTimerPoll() without the timer
+static inline bool IsTimerPoll(const uint8_t* memory, uint16_t start)
+{
+    if (start > 0xFFA)
+        return false;
+
+    uint16_t load = OpcodeAt(memory, start);
+    return (load & 0xF0FF) == 0xF007 && OpcodeAt(memory, start + 2) == (0x3000 | (load & 0x0F00)) && OpcodeAt(memory, start + 4) == (0x1000 | start);
+}
+
+chip8Batch::chip8Batch(size_t lanes, uint32_t opcodesPerFrame)
+{
+    m_Lanes = lanes;
+    m_OpcodesPerFrame = opcodesPerFrame;
+
+    // Whole groups only, the fixed trip count lets the compiler vectorize.
+    // The extra lanes run the rom too but are never observed
+    m_Padded = (lanes + GROUP - 1) / GROUP * GROUP;
+
+    // Rows and memory blocks 4K apart would all compete for the same cache sets
+    m_RowStride = m_Padded + GROUP;
+    m_Registers.resize(16 * m_RowStride);
+    m_AddressI.resize(m_Padded);
+    m_ProgramCounter.resize(m_Padded);
+    m_DelayTimer.resize(m_Padded);
+    m_SoundTimer.resize(m_Padded);
+    m_Keys.resize(m_Padded);
+    m_RandomState.resize(m_Padded);
+    m_StackPointer.resize(m_Padded);
+
+    m_Stack.resize(16 * m_Padded);
+    m_Memory.resize(MEMORY_STRIDE * m_Padded);
+    m_Screen.resize(32 * m_Padded);
+
+    m_Rom.resize(0x1000);
+    m_Code.resize(0x1000);
+    m_CodeOp.resize(0x1000);
+    m_IdleCode.resize(0x1000);
+    m_Written.resize(m_Padded);
+
+    loadRom(nullptr, 0);
+}
+
+size_t chip8Batch::getLanes()
+{
+    return m_Lanes;
+}
+
+bool chip8Batch::loadRom(const uint8_t* data, size_t size, uint32_t seed)
+{
+    if (size > 0x1000 - 0x200)
+    {
+        printf("Rom is too large, %d bytes fit\n", 0x1000 - 0x200);
+        return false;
+    }
+
+    // Same reset as chip8::CPUReset()
+    std::fill(m_Registers.begin(), m_Registers.end(), 0);
+    std::fill(m_AddressI.begin(), m_AddressI.end(), 0);
+    std::fill(m_ProgramCounter.begin(), m_ProgramCounter.end(), 0x200);
+    std::fill(m_DelayTimer.begin(), m_DelayTimer.end(), 0);
+    std::fill(m_SoundTimer.begin(), m_SoundTimer.end(), 0);
+    std::fill(m_Keys.begin(), m_Keys.end(), 0);
+    std::fill(m_StackPointer.begin(), m_StackPointer.end(), 0);
+    std::fill(m_Stack.begin(), m_Stack.end(), 0);
+    std::fill(m_Memory.begin(), m_Memory.end(), 0);
+    std::fill(m_Screen.begin(), m_Screen.end(), 0);
+    std::fill(m_Rom.begin(), m_Rom.end(), 0);
+    std::fill(m_Written.begin(), m_Written.end(), 0);
+
+    if (size > 0)
+        memcpy(&m_Rom[0x200], data, size);
+
+    for (size_t address = 0; address < 0x1000; address++)
+    {
+        m_Code[address] = (m_Rom[address] << 8) | m_Rom[(address + 1) & 0xFFF];
+        m_CodeOp[address] = g_DecodeTable[m_Code[address]].op;
+    }
+
+    for (uint16_t address = 0; address < 0x1000; address++)
+    {
+        const Instruction& in = g_DecodeTable[m_Code[address]];
+
+        m_IdleCode[address] = in.op == Op::OpFX0A || (in.op == Op::Op1NNN && in.nnn == address) ||
+                              IsTimerPoll(m_Rom.data(), address) ||
+                              (address >= 2 && IsTimerPoll(m_Rom.data(), address - 2)) ||
+                              (address >= 4 && IsTimerPoll(m_Rom.data(), address - 4));
+    }
+
+    for (size_t lane = 0; lane < m_Padded; lane++)
+    {
+        memcpy(&m_Memory[lane * MEMORY_STRIDE], m_Rom.data(), 0x1000);
+
+        setSeed(lane, seed + (uint32_t)lane);
+    }
+
+    return true;
+}
+
+void chip8Batch::setSeed(size_t lane, uint32_t seed)
+{
+    m_RandomState[lane] = seed ? seed : 0x2545F491;
+}
+
+const uint64_t* chip8Batch::step(const uint16_t* actions)
+{
+    if (actions)
+        memcpy(m_Keys.data(), actions, m_Lanes * sizeof(uint16_t));
+
+    // Lanes are independent, so each group runs its whole frame while its
+    // memory is still in cache instead of sweeping every lane per opcode
+    for (size_t first = 0; first < m_Padded; first += GROUP)
+    {
+        // Keys and timers only change between frames, so a lane that starts
+        // the frame in an idle loop spins in it until the end of the frame
+        uint8_t active[GROUP];
+        size_t  count = 0;
+
+        for (size_t i = 0; i < GROUP; i++)
+        {
+            active[count] = (uint8_t)i;
+            count += !SkipIdle(first + i, m_OpcodesPerFrame);
+        }
+
+        for (uint32_t opcode = 0; opcode < m_OpcodesPerFrame; opcode++)
+        {
+            if (count == GROUP)
+                StepGroup<true>(first, active, count);
+            else if (count > 0)
+                StepGroup<false>(first, active, count);
+        }
+    }
+
+    for (size_t lane = 0; lane < m_Padded; lane++)
+    {
+        m_DelayTimer[lane] -= m_DelayTimer[lane] > 0;
+        m_SoundTimer[lane] -= m_SoundTimer[lane] > 0;
+    }
+
+    return m_Screen.data();
+}
+
+const uint64_t* chip8Batch::getObservations()
+{
+    return m_Screen.data();
+}
+
+uint8_t chip8Batch::getRegister(size_t lane, int index)
+{
+    return m_Registers[index * m_RowStride + lane];
+}
+
+void chip8Batch::getState(size_t lane, chip8State& state)
+{
+    memset(&state, 0, sizeof(state));
+
+    memcpy(state.screen, &m_Screen[lane * 32], sizeof(state.screen));
+    memcpy(state.memory, &m_Memory[lane * MEMORY_STRIDE], sizeof(state.memory));
+    memcpy(state.stack, &m_Stack[lane * 16], sizeof(state.stack));
+
+    for (int i = 0; i < 16; i++)
+    {
+        state.registers[i] = m_Registers[i * m_RowStride + lane];
+        state.keys[i] = (m_Keys[lane] >> i) & 1;
+    }
+
+    state.randomState = m_RandomState[lane];
+    state.addressI = m_AddressI[lane];
+    state.programCounter = m_ProgramCounter[lane];
+    state.stackPointer = m_StackPointer[lane];
+    state.delayTimer = m_DelayTimer[lane];
+    state.soundTimer = m_SoundTimer[lane];
+}
+
+void chip8Batch::setState(size_t lane, const chip8State& state)
+{
+    memcpy(&m_Screen[lane * 32], state.screen, sizeof(state.screen));
+    memcpy(&m_Memory[lane * MEMORY_STRIDE], state.memory, sizeof(state.memory));
+
+    m_Written[lane] = 0;
+    for (int line = 0; line < 64; line++)
+    {
+        if (memcmp(&state.memory[line * 64], &m_Rom[line * 64], 64) != 0)
+            MarkWritten(lane, (uint16_t)(line * 64), 64);
+    }
+    memcpy(&m_Stack[lane * 16], state.stack, sizeof(state.stack));
+
+    m_Keys[lane] = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        m_Registers[i * m_RowStride + lane] = state.registers[i];
+        m_Keys[lane] |= (state.keys[i] == 1) << i;
+    }
+
+    m_RandomState[lane] = state.randomState;
+    m_AddressI[lane] = state.addressI;
+    m_ProgramCounter[lane] = state.programCounter;
+    m_StackPointer[lane] = state.stackPointer;
+    m_DelayTimer[lane] = state.delayTimer;
+    m_SoundTimer[lane] = state.soundTimer;
+}
+
+/*
+    PRIVATE Functions
+*/
+template <bool All>
+void chip8Batch::StepGroup(size_t first, const uint8_t* active, size_t count)
+{
+    uint16_t  opcode[GROUP];
+    uint16_t* pc = &m_ProgramCounter[first];
+
+    // The n-th running lane of the group, without idle lanes that is lane n
+    auto laneAt = [active](size_t n) -> size_t { return All ? n : active[n]; };
+    size_t lead = laneAt(0);
+
+    // Lanes running the same ALU opcode read and write whole register rows
+    // when the whole group runs, the other ops run their usual code on every
+    // running lane
+    auto uniform = [&](Op op)
+    {
+        uint8_t alu = Classify(g_DecodeTable[opcode[lead]]);
+        if (All && alu != AluScalar)
+            StepAlu(first, opcode[lead], alu);
+        else
+            ExecuteLanes(op, first, opcode, All ? nullptr : active, count);
+    };
+
+    // Lanes share m_Code for code they never wrote to, so lanes at the same
+    // program counter fetch one opcode, which is the common case while copies
+    // of a ROM have not diverged
+    size_t samePc = 1;
+    while (samePc < count && pc[laneAt(samePc)] == pc[lead])
+        samePc++;
+
+    uint64_t anyWritten = 0;
+    if (samePc == count)
+    {
+        for (size_t n = 0; n < count; n++)
+            anyWritten |= m_Written[first + laneAt(n)];
+    }
+
+    if (samePc == count && !Written(anyWritten, pc[lead], 1))
+    {
+        uint16_t shared = m_Code[pc[lead] & 0xFFF];
+        Op       op = m_CodeOp[pc[lead] & 0xFFF];
+
+        for (size_t n = 0; n < count; n++)
+        {
+            opcode[laneAt(n)] = shared;
+            pc[laneAt(n)] += 2;
+        }
+
+        uniform(op);
+        return;
+    }
+
+    // Otherwise the lanes are sorted by op while fetching, so each op is
+    // dispatched once per group and its lanes run in a loop instead of one
+    // mispredicted switch each
+    uint8_t  lanes[(size_t)Op::Count][GROUP];
+    uint8_t* tail[(size_t)Op::Count];
+    uint64_t used = 0;
+
+    for (size_t op = 0; op < (size_t)Op::Count; op++)
+        tail[op] = lanes[op];
+
+    // Locals, the compiler would reload the members after every store to lanes
+    const uint64_t* written = &m_Written[first];
+    const uint8_t*  memory = &m_Memory[first * MEMORY_STRIDE];
+    const uint16_t* code = m_Code.data();
+    const Op*       codeOp = m_CodeOp.data();
+
+    for (size_t n = 0; n < count; n++)
+    {
+        size_t   i = laneAt(n);
+        uint16_t address = pc[i] & 0xFFF;
+        Op       op;
+
+        // An opcode starting in line k only checks bit k, see m_Written
+        if ((written[i] >> (address >> 6)) & 1)
+        {
+            const uint8_t* lane = &memory[i * MEMORY_STRIDE];
+            opcode[i] = (lane[address] << 8) | lane[(address + 1) & 0xFFF];
+            op = g_DecodeTable[opcode[i]].op;
+        }
+        else
+        {
+            opcode[i] = code[address];
+            op = codeOp[address];
+        }
+
+        pc[i] += 2;
+        used |= 1ull << (size_t)op;
+        *tail[(size_t)op]++ = (uint8_t)i;
+    }
+
+    // Only the ops some lane fetched, in order
+    for (; used != 0; used &= used - 1)
+    {
+        size_t op = LowestBit(used);
+        size_t size = tail[op] - lanes[op];
+
+        // Lanes that diverged can still meet on the same opcode
+        if (size == count)
+        {
+            bool sameOpcode = true;
+            for (size_t n = 0; n < count; n++)
+                sameOpcode &= opcode[laneAt(n)] == opcode[lead];
+
+            if (sameOpcode)
+            {
+                uniform((Op)op);
+                return;
+            }
+        }
+
+        ExecuteLanes((Op)op, first, opcode, lanes[op], size);
+    }
+}
+
+void chip8Batch::StepAlu(size_t first, uint16_t opcode, uint8_t alu)
+{
+    uint8_t kind = alu & ~ALU_IMMEDIATE;
+    uint8_t a[GROUP], b[GROUP];
+    uint8_t result[GROUP], flag[GROUP], skip[GROUP];
+
+    uint8_t x = (opcode >> 8) & 0xF;
+    uint8_t y = (opcode >> 4) & 0xF;
+
+    memcpy(a, &m_Registers[x * m_RowStride + first], GROUP);
+
+    if (alu & ALU_IMMEDIATE)
+        memset(b, opcode & 0xFF, GROUP);
+    else
+        memcpy(b, &m_Registers[y * m_RowStride + first], GROUP);
+
+    // Branch free evaluation of every ALU kind, vectorized across the lanes.
+    // Each kind gives an all ones mask that selects its result
+    for (size_t i = 0; i < GROUP; i++)
+    {
+        uint8_t k = kind, x = a[i], y = b[i];
+        uint8_t sum = x + y;
+
+        uint8_t r = y & -(k == AluLoad);
+        r |= sum & -(k == AluAdd || k == AluAddCarry);
+        r |= (x | y) & -(k == AluOr);
+        r |= (x & y) & -(k == AluAnd);
+        r |= (x ^ y) & -(k == AluXor);
+        r |= (uint8_t)(x - y) & -(k == AluSub);
+        r |= (uint8_t)(y - x) & -(k == AluSubReverse);
+        r |= (x >> 1) & -(k == AluShiftRight);
+        r |= (uint8_t)(x << 1) & -(k == AluShiftLeft);
+
+        uint8_t f = (sum < x) & -(k == AluAddCarry);
+        f |= (x > y) & -(k == AluSub);
+        f |= (x < y) & -(k == AluSubReverse);
+        f |= (x & 1) & -(k == AluShiftRight);
+        f |= (x >> 7) & -(k == AluShiftLeft);
+
+        uint8_t s = (x == y) & -(k == AluSkipEqual);
+        s |= (x != y) & -(k == AluSkipNotEqual);
+
+        result[i] = r;
+        flag[i] = f;
+        skip[i] = s;
+    }
+
+    // Write the results back as whole rows
+    if (kind == AluSkipEqual || kind == AluSkipNotEqual)
+    {
+        uint16_t* pc = &m_ProgramCounter[first];
+        for (size_t i = 0; i < GROUP; i++)
+            pc[i] += skip[i] * 2;
+    }
+    else
+    {
+        memcpy(&m_Registers[x * m_RowStride + first], result, GROUP);
+
+        if (kind >= AluAddCarry)
+            memcpy(&m_Registers[0xF * m_RowStride + first], flag, GROUP);
+    }
+}
+
+void chip8Batch::ExecuteLanes(Op op, size_t first, const uint16_t* opcode, const uint8_t* lanes, size_t count)
+{
+    // Same behaviour as chip8::Execute(), on the lanes' slices of the arrays.
+    // Every case loops over the lanes of the group that run this op, which are
+    // the first count ones without a list. The op is known, the operands are
+    // taken straight from the opcode bits instead of the decode table
+    auto operands = [](uint16_t opcode)
+    {
+        Instruction in = { Op::Unknown, 0, 0, 0, 0, 0, 0 };
+        in.x   = (opcode & 0x0F00) >> 8;
+        in.y   = (opcode & 0x00F0) >> 4;
+        in.n   = opcode & 0x000F;
+        in.nn  = opcode & 0x00FF;
+        in.nnn = opcode & 0x0FFF;
+        return in;
+    };
+
+    // One loop for both, so every body is inlined once instead of called per lane
+    auto each = [&](auto body)
+    {
+        for (size_t n = 0; n < count; n++)
+        {
+            size_t i = lanes ? lanes[n] : n;
+            body(first + i, operands(opcode[i]));
+        }
+    };
+
+    // Plain pointers, a byte store through a member would make the compiler
+    // load every member again after it
+    uint8_t*        registers = m_Registers.data();
+    size_t          stride = m_RowStride;
+    uint16_t*       pc = m_ProgramCounter.data();
+    uint16_t*       I = m_AddressI.data();
+    uint8_t*        sp = m_StackPointer.data();
+    uint16_t*       stack = m_Stack.data();
+    uint64_t*       screen = m_Screen.data();
+    const uint16_t* keys = m_Keys.data();
+    uint8_t*        delayTimer = m_DelayTimer.data();
+    uint8_t*        soundTimer = m_SoundTimer.data();
+    const uint8_t*  rom = m_Rom.data();
+    const uint64_t* written = m_Written.data();
+
+    auto V = [registers, stride](int index, size_t lane) -> uint8_t& { return registers[index * stride + lane]; };
+    auto Memory = [this](size_t lane) { return &m_Memory[lane * MEMORY_STRIDE]; };
+
+    // Reads go to m_Rom where the lane did not write, like opcode fetches
+    auto Readable = [&](size_t lane, uint16_t address, int length) -> const uint8_t*
+    {
+        return Written(written[lane], address, length) ? Memory(lane) : rom;
+    };
+
+    switch (op)
+    {
+        case Op::Op00E0: each([&](size_t lane, const Instruction&) { memset(&screen[lane * 32], 0, 32 * sizeof(uint64_t)); }); break;
+        case Op::Op00EE: each([&](size_t lane, const Instruction&) { pc[lane] = stack[lane * 16 + (--sp[lane] & 0xF)]; }); break;
+        case Op::Op1NNN: each([&](size_t lane, const Instruction& in) { pc[lane] = in.nnn; }); break;
+
+        case Op::Op2NNN:
+            each([&](size_t lane, const Instruction& in)
+            {
+                stack[lane * 16 + (sp[lane]++ & 0xF)] = pc[lane];
+                pc[lane] = in.nnn;
+            });
+            break;
+
+        case Op::Op3XNN: each([&](size_t lane, const Instruction& in) { pc[lane] += (V(in.x, lane) == in.nn) * 2; }); break;
+        case Op::Op4XNN: each([&](size_t lane, const Instruction& in) { pc[lane] += (V(in.x, lane) != in.nn) * 2; }); break;
+        case Op::Op5XY0: each([&](size_t lane, const Instruction& in) { pc[lane] += (V(in.x, lane) == V(in.y, lane)) * 2; }); break;
+        case Op::Op6XNN: each([&](size_t lane, const Instruction& in) { V(in.x, lane) = in.nn; }); break;
+        case Op::Op7XNN: each([&](size_t lane, const Instruction& in) { V(in.x, lane) += in.nn; }); break;
+        case Op::Op8XY0: each([&](size_t lane, const Instruction& in) { V(in.x, lane) = V(in.y, lane); }); break;
+        case Op::Op8XY1: each([&](size_t lane, const Instruction& in) { V(in.x, lane) |= V(in.y, lane); }); break;
+        case Op::Op8XY2: each([&](size_t lane, const Instruction& in) { V(in.x, lane) &= V(in.y, lane); }); break;
+        case Op::Op8XY3: each([&](size_t lane, const Instruction& in) { V(in.x, lane) ^= V(in.y, lane); }); break;
+
+        // VF is cleared or set before the result is written, as in chip8::Execute()
+        case Op::Op8XY4:
+            each([&](size_t lane, const Instruction& in)
+            {
+                V(0xF, lane) = 0;
+
+                uint16_t value = V(in.x, lane) + V(in.y, lane);
+                V(0xF, lane) = value > 255;
+                V(in.x, lane) = V(in.x, lane) + V(in.y, lane);
+            });
+            break;
+
+        case Op::Op8XY5:
+            each([&](size_t lane, const Instruction& in)
+            {
+                V(0xF, lane) = 0;
+
+                uint16_t xval = V(in.x, lane);
+                uint16_t yval = V(in.y, lane);
+                V(0xF, lane) = xval > yval;
+                V(in.x, lane) = xval - yval;
+            });
+            break;
+
+        case Op::Op8XY6:
+            each([&](size_t lane, const Instruction& in)
+            {
+                V(0xF, lane) = V(in.x, lane) & 0x1;
+                V(in.x, lane) >>= 1;
+            });
+            break;
+
+        case Op::Op8XY7:
+            each([&](size_t lane, const Instruction& in)
+            {
+                V(0xF, lane) = 0;
+
+                uint16_t xval = V(in.x, lane);
+                uint16_t yval = V(in.y, lane);
+                V(0xF, lane) = xval < yval;
+                V(in.x, lane) = yval - xval;
+            });
+            break;
+
+        case Op::Op8XYE:
+            each([&](size_t lane, const Instruction& in)
+            {
+                V(0xF, lane) = V(in.x, lane) >> 7;
+                V(in.x, lane) <<= 1;
+            });
+            break;
+
+        case Op::Op9XY0: each([&](size_t lane, const Instruction& in) { pc[lane] += (V(in.x, lane) != V(in.y, lane)) * 2; }); break;
+        case Op::OpANNN: each([&](size_t lane, const Instruction& in) { I[lane] = in.nnn; }); break;
+        case Op::OpBNNN: each([&](size_t lane, const Instruction& in) { pc[lane] = in.nnn + V(0, lane); }); break;
+        case Op::OpCXNN: each([&](size_t lane, const Instruction& in) { V(in.x, lane) = in.nn & Random(lane); }); break;
+
+        case Op::OpDXYN:
+            each([&](size_t lane, const Instruction& in)
+            {
+                const uint8_t* memory = Readable(lane, I[lane], in.n > 0 ? in.n : 1);
+                uint64_t* rows = &screen[lane * 32];
+
+                uint16_t coordx = V(in.x, lane) & 63;
+                uint16_t coordy = V(in.y, lane) & 31;
+
+                uint64_t collision = 0;
+                for (int yline = 0; yline < in.n && coordy + yline < 32; yline++)
+                {
+                    uint64_t sprite = ((uint64_t)memory[(I[lane] + yline) & 0xFFF] << 56) >> coordx;
+
+                    collision |= rows[coordy + yline] & sprite;
+                    rows[coordy + yline] ^= sprite;
+                }
+
+                V(0xF, lane) = collision != 0;
+            });
+            break;
+
+        case Op::OpEX9E: each([&](size_t lane, const Instruction& in) { pc[lane] += ((keys[lane] >> chip8::KeyIndex(V(in.x, lane))) & 1) * 2; }); break;
+        case Op::OpEXA1: each([&](size_t lane, const Instruction& in) { pc[lane] += (~keys[lane] >> chip8::KeyIndex(V(in.x, lane)) & 1) * 2; }); break;
+
+        case Op::OpFX07: each([&](size_t lane, const Instruction& in) { V(in.x, lane) = delayTimer[lane]; }); break;
+
+        case Op::OpFX0A:
+            each([&](size_t lane, const Instruction& in)
+            {
+                uint16_t pressed = keys[lane];
+                if (pressed == 0)
+                    pc[lane] -= 2;
+                else
+                {
+                    int key = 0;
+                    while (!((pressed >> key) & 1))
+                        key++;
+
+                    V(in.x, lane) = key;
+                }
+            });
+            break;
+
+        case Op::OpFX15: each([&](size_t lane, const Instruction& in) { delayTimer[lane] = V(in.x, lane); }); break;
+        case Op::OpFX18: each([&](size_t lane, const Instruction& in) { soundTimer[lane] = V(in.x, lane); }); break;
+        case Op::OpFX1E: each([&](size_t lane, const Instruction& in) { I[lane] = I[lane] + V(in.x, lane); }); break;
+        case Op::OpFX29: each([&](size_t lane, const Instruction& in) { I[lane] = V(in.x, lane) * 5; }); break;
+
+        case Op::OpFX33:
+            each([&](size_t lane, const Instruction& in)
+            {
+                uint8_t* memory = Memory(lane);
+                uint8_t value = V(in.x, lane);
+
+                MarkWritten(lane, I[lane], 3);
+
+                memory[I[lane] & 0xFFF] = value / 100;
+                memory[(I[lane] + 1) & 0xFFF] = (value / 10) % 10;
+                memory[(I[lane] + 2) & 0xFFF] = value % 10;
+            });
+            break;
+
+        case Op::OpFX55:
+            each([&](size_t lane, const Instruction& in)
+            {
+                uint8_t* memory = Memory(lane);
+                for (int i = 0; i <= in.x; i++)
+                    memory[(I[lane] + i) & 0xFFF] = V(i, lane);
+
+                MarkWritten(lane, I[lane], in.x + 1);
+
+                I[lane] = I[lane] + in.x + 1;
+            });
+            break;
+
+        case Op::OpFX65:
+            each([&](size_t lane, const Instruction& in)
+            {
+                const uint8_t* memory = Readable(lane, I[lane], in.x + 1);
+                for (int i = 0; i <= in.x; i++)
+                    V(i, lane) = memory[(I[lane] + i) & 0xFFF];
+
+                I[lane] = I[lane] + in.x + 1;
+            });
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool chip8Batch::SkipIdle(size_t lane, uint32_t opcodes)
+{
+    // The idle loops chip8::getIdleLoop() knows, see there. Most lanes are
+    // ruled out by m_IdleCode without touching their own memory
+    uint16_t& pc = m_ProgramCounter[lane];
+    if (pc > 0xFFA || (!m_IdleCode[pc] && !Written(m_Written[lane], pc - 4, 10)))
+        return false;
+
+    const uint8_t* memory = &m_Memory[lane * MEMORY_STRIDE];
+    uint8_t        delay = m_DelayTimer[lane];
+
+    auto isTimerPoll = [&](uint16_t start) { return delay > 0 && IsTimerPoll(memory, start); };
+
+    const Instruction& in = g_DecodeTable[OpcodeAt(memory, pc)];
+    uint16_t start;
+
+    switch (in.op)
+    {
+        case Op::OpFX0A:
+            return m_Keys[lane] == 0;
+
+        case Op::Op1NNN:
+            if (in.nnn == pc)
+                return true;
+
+            if (pc < 4 || in.nnn != pc - 4 || !isTimerPoll(pc - 4))
+                return false;
+
+            start = pc - 4;
+            break;
+
+        case Op::OpFX07:
+            if (!isTimerPoll(pc))
+                return false;
+
+            start = pc;
+            break;
+
+        case Op::Op3XNN:
+            if (pc < 2 || !isTimerPoll(pc - 2) || m_Registers[in.x * m_RowStride + lane] == 0)
+                return false;
+
+            start = pc - 2;
+            break;
+
+        default:
+            return false;
+    }
+
+    // Same as chip8::SkipIdle(), VX holds the delay timer once an FX07 ran
+    uint32_t phase = (pc - start) / 2;
+    if (opcodes > (3 - phase) % 3)
+        m_Registers[(memory[start] & 0xF) * m_RowStride + lane] = delay;
+
+    pc = start + 2 * (uint16_t)((phase + opcodes) % 3);
+    return true;
+}
+
+bool chip8Batch::Written(uint64_t written, uint16_t address, int length)
+{
+    // At most 64 bytes, so the first and the last line cover them
+    return ((written >> ((address & 0xFFF) >> 6)) | (written >> (((address + length - 1) & 0xFFF) >> 6))) & 1;
+}
+
+void chip8Batch::MarkWritten(size_t lane, uint16_t address, int length)
+{
+    // The line before the first byte too, an opcode there may end in it.
+    // Up to 64 bytes either still start in that line or in the last one
+    m_Written[lane] |= 1ull << (((address - 1) & 0xFFF) >> 6);
+    m_Written[lane] |= 1ull << (((address + length - 1) & 0xFFF) >> 6);
+}
+
+uint8_t chip8Batch::Random(size_t lane)
+{
+    // xorshift32, the same sequence as chip8::Random()
+    uint32_t& state = m_RandomState[lane];
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return (uint8_t)(state >> 24);
+}
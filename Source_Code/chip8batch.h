@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.h"
+
+/*
+// Batched machines
+//
+// Holds many independent machines in structure of arrays layout and steps
+// them all one frame at a time, for workloads like reinforcement learning
+// that run thousands of copies of one ROM. Each register, I, PC, the timers
+// and the keys are one contiguous lane array.
+//
+// Lanes run in groups of GROUP, one opcode per lane at a time. Opcodes are
+// fetched from one shared copy of the ROM until a lane writes over its code,
+// then the lanes are sorted by op so each op is dispatched once per group
+// and runs as a loop over its lanes. When every lane of a group runs the
+// same ALU opcode (3XNN to 9XY0) it is evaluated on whole register arrays by
+// plain loops that the compiler turns into SIMD. Lanes that start a frame in
+// an idle loop are advanced to its end without running it, like
+// CycleScheduler does for a single machine.
+//
+// Behaves exactly like chip8 with the Decoded engine, except that unknown
+// opcodes are skipped silently.
+*/
+
+class chip8Batch
+{
+public:
+    chip8Batch(size_t lanes, uint32_t opcodesPerFrame = 800 / 60);
+
+    size_t getLanes();
+
+    // Loads the rom into every lane and resets all of them, lane i is seeded with seed + i
+    bool loadRom(const uint8_t* data, size_t size, uint32_t seed = 1);
+
+    void setSeed(size_t lane, uint32_t seed);
+
+    // actions holds one key mask per lane (bit k is key k), nullptr keeps the keys.
+    // Runs one frame on every lane and returns the observations, see getObservations()
+    const uint64_t* step(const uint16_t* actions);
+
+    // 32 rows of 64 pixels per lane, lane after lane, the most significant bit is x = 0
+    const uint64_t* getObservations();
+
+    uint8_t getRegister(size_t lane, int index);
+
+    // Converts a lane from and to the single machine layout
+    void getState(size_t lane, chip8State& state);
+    void setState(size_t lane, const chip8State& state);
+
+private:
+    // Lanes fetched and evaluated together
+    static const size_t GROUP = 256;
+
+    // Bytes per lane in m_Memory, one cache line more than the 4K a lane needs
+    static const size_t MEMORY_STRIDE = 0x1000 + 64;
+
+    size_t   m_Lanes;
+    size_t   m_Padded;      // lanes rounded up to whole groups
+    size_t   m_RowStride;
+    uint32_t m_OpcodesPerFrame;
+
+    // One array per register, m_Registers[r * m_RowStride + lane]
+    std::vector<uint8_t>  m_Registers;
+    std::vector<uint16_t> m_AddressI;
+    std::vector<uint16_t> m_ProgramCounter;
+    std::vector<uint8_t>  m_DelayTimer;
+    std::vector<uint8_t>  m_SoundTimer;
+    std::vector<uint16_t> m_Keys;
+    std::vector<uint32_t> m_RandomState;
+    std::vector<uint8_t>  m_StackPointer;
+
+    // Per lane blocks
+    std::vector<uint16_t> m_Stack;      // 16 entries per lane
+    std::vector<uint8_t>  m_Memory;     // 4K per lane
+    std::vector<uint64_t> m_Screen;     // 32 rows per lane
+
+    // The memory all lanes boot with and the opcode at each of its addresses.
+    // Lanes fetch and read from them instead of their own 4K while the 64
+    // byte line involved was never written
+    std::vector<uint8_t>  m_Rom;
+    std::vector<uint16_t> m_Code;
+    std::vector<Op>       m_CodeOp;
+
+    // Set on the addresses of m_Rom an idle loop can run at, the FX0A, the
+    // jumps to themselves and the three opcodes of every timer poll
+    std::vector<uint8_t>  m_IdleCode;
+
+    // Per lane, bit k is set once line k or the first byte of line k + 1 may
+    // differ from m_Rom, so an opcode starting in line k only checks bit k
+    std::vector<uint64_t> m_Written;
+
+private:
+    // Runs one opcode on the count lanes of the group listed in active, All
+    // when that is the whole group in order
+    template <bool All>
+    void StepGroup(size_t first, const uint8_t* active, size_t count);
+    void StepAlu(size_t first, uint16_t opcode, uint8_t alu);
+    void ExecuteLanes(Op op, size_t first, const uint16_t* opcode, const uint8_t* lanes, size_t count);
+
+    // Whether any of the length (at most 64) bytes from address is in a line set in written
+    static bool Written(uint64_t written, uint16_t address, int length);
+    void MarkWritten(size_t lane, uint16_t address, int length);
+
+    // Advances a lane that is in an idle loop by that many opcodes without
+    // running them, like chip8::SkipIdle(). Returns false and does nothing
+    // when the lane is doing real work
+    bool SkipIdle(size_t lane, uint32_t opcodes);
+
+    uint8_t Random(size_t lane);
+};
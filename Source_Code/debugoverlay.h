@@ -0,0 +1,298 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "chip8.h"
+
+/*
+// Debug overlay
+//
+// Shows the registers, I, PC, stack, timers and keypad of a guest state next
+// to the screen. The glyphs of the font are looked up once in setFont, every
+// line is a fixed run of quads in one vertex array, and Update formats each
+// line into a small char buffer and rebuilds its quads only if it differs
+// from what is shown. Nothing is allocated after setFont and the whole
+// overlay is a single draw call.
+//
+// Lines are laid out in two columns of ROWS lines, every line has room for
+// CELLS characters.
+*/
+
+class DebugOverlay : public sf::Drawable
+{
+public:
+    // Host side values shown below the guest state
+    struct Status
+    {
+        bool         idle;
+        bool         turbo;
+        float        speed;         // multiple of real time while in turbo
+        unsigned int runAhead;
+        float        runAheadCost;  // ms per frame
+    };
+
+    DebugOverlay() : m_Vertices(sf::Triangles, LINES * CELLS * 6)
+    {
+        memset(m_Glyphs, 0, sizeof(m_Glyphs));
+        memset(m_Lines, ' ', sizeof(m_Lines));
+
+        m_Texture = nullptr;
+        m_LineSpacing = 0.0f;
+        m_Baseline = 0.0f;
+        m_ColumnWidth = 0.0f;
+    }
+
+    // Caches the printable ASCII glyphs of the font at characterSize and lays out all lines again
+    void setFont(const sf::Font& font, unsigned int characterSize, sf::Vector2f position, float columnWidth)
+    {
+        for (int c = FIRST_CHAR; c <= LAST_CHAR; c++)
+        {
+            const sf::Glyph& glyph = font.getGlyph(c, characterSize, false);
+
+            CachedGlyph& cached = m_Glyphs[c - FIRST_CHAR];
+            cached.advance = glyph.advance;
+            cached.left = glyph.bounds.left;
+            cached.top = glyph.bounds.top;
+            cached.width = glyph.bounds.width;
+            cached.height = glyph.bounds.height;
+            cached.u = (float)glyph.textureRect.left;
+            cached.v = (float)glyph.textureRect.top;
+            cached.uWidth = (float)glyph.textureRect.width;
+            cached.vHeight = (float)glyph.textureRect.height;
+        }
+
+        // Taken after the glyphs, looking them up can grow the texture
+        m_Texture = &font.getTexture(characterSize);
+        m_LineSpacing = font.getLineSpacing(characterSize);
+        m_Baseline = (float)characterSize;
+        m_Position = position;
+        m_ColumnWidth = columnWidth;
+
+        for (int line = 0; line < LINES; line++)
+            BuildLine(line);
+    }
+
+    // Formats the state into the lines, returns whether any of them changed
+    bool Update(const chip8State& state, const Status& status)
+    {
+        bool changed = false;
+        char text[CELLS];
+
+        // First column, registers, I and PC, then the keypad in its 4x4 layout
+        for (int i = 0; i < 16; i++)
+        {
+            Begin(text);
+            text[0] = 'V';
+            text[1] = HEX[i];
+            Hex(text + 3, state.registers[i], 2);
+            changed |= setLine(i, text);
+        }
+
+        Begin(text);
+        text[0] = 'I';
+        Hex(text + 3, state.addressI, 4);
+        changed |= setLine(16, text);
+
+        Begin(text);
+        Text(text, "PC");
+        Hex(text + 3, state.programCounter, 4);
+        changed |= setLine(17, text);
+
+        static const uint8_t KEYPAD[4][4] = { { 0x1, 0x2, 0x3, 0xC }, { 0x4, 0x5, 0x6, 0xD }, { 0x7, 0x8, 0x9, 0xE }, { 0xA, 0x0, 0xB, 0xF } };
+        for (int row = 0; row < 4; row++)
+        {
+            Begin(text);
+            for (int column = 0; column < 4; column++)
+            {
+                uint8_t key = KEYPAD[row][column];
+                text[column * 2] = state.keys[key] ? HEX[key] : '.';
+            }
+            changed |= setLine(18 + row, text);
+        }
+
+        // Second column, timers and the stack, then the host status
+        Begin(text);
+        Text(text, "DT");
+        Decimal(text + 3, state.delayTimer);
+        changed |= setLine(ROWS, text);
+
+        Begin(text);
+        Text(text, "ST");
+        Decimal(text + 3, state.soundTimer);
+        changed |= setLine(ROWS + 1, text);
+
+        Begin(text);
+        Text(text, "SP");
+        Decimal(text + 3, state.stackPointer);
+        changed |= setLine(ROWS + 2, text);
+
+        // Only the entries below SP are return addresses
+        for (int i = 0; i < 16; i++)
+        {
+            Begin(text);
+            if (i < state.stackPointer)
+            {
+                text[0] = HEX[i];
+                Hex(text + 3, state.stack[i], 4);
+            }
+            changed |= setLine(ROWS + 3 + i, text);
+        }
+
+        Begin(text);
+        if (status.idle)
+            Text(text, "Idle");
+        changed |= setLine(ROWS + 19, text);
+
+        Begin(text);
+        if (status.turbo)
+        {
+            // Tenths, e.g. T 12.5x
+            uint32_t tenths = (uint32_t)(std::min(std::max(status.speed, 0.0f), 999.0f) * 10.0f + 0.5f);
+            text[0] = 'T';
+            char* end = Decimal(text + 2, tenths / 10);
+            end[0] = '.';
+            end[1] = (char)('0' + tenths % 10);
+            end[2] = 'x';
+        }
+        changed |= setLine(ROWS + 20, text);
+
+        Begin(text);
+        if (status.runAhead > 0)
+        {
+            // Hundredths of a ms, e.g. RA 0.25
+            uint32_t hundredths = (uint32_t)(std::min(std::max(status.runAheadCost, 0.0f), 99.0f) * 100.0f + 0.5f);
+            Text(text, "RA");
+            char* end = Decimal(text + 3, hundredths / 100);
+            end[0] = '.';
+            end[1] = (char)('0' + hundredths / 10 % 10);
+            end[2] = (char)('0' + hundredths % 10);
+        }
+        changed |= setLine(ROWS + 21, text);
+
+        return changed;
+    }
+
+private:
+    static const int ROWS = 22;
+    static const int LINES = ROWS * 2;
+    static const int CELLS = 8;
+
+    static const int FIRST_CHAR = ' ';
+    static const int LAST_CHAR = '~';
+
+    static constexpr const char* HEX = "0123456789ABCDEF";
+
+    // What a quad needs from an sf::Glyph
+    struct CachedGlyph
+    {
+        float advance;
+        float left, top, width, height;
+        float u, v, uWidth, vHeight;
+    };
+
+    CachedGlyph        m_Glyphs[LAST_CHAR - FIRST_CHAR + 1];
+    char               m_Lines[LINES][CELLS];
+    sf::VertexArray    m_Vertices;              // 6 per cell, blank cells are empty quads
+
+    const sf::Texture* m_Texture;
+    sf::Vector2f       m_Position;
+    float              m_LineSpacing;
+    float              m_Baseline;
+    float              m_ColumnWidth;
+
+private:
+    void draw(sf::RenderTarget& target, sf::RenderStates states) const override
+    {
+        // Nothing to show without a font
+        if (!m_Texture)
+            return;
+
+        states.texture = m_Texture;
+        target.draw(m_Vertices, states);
+    }
+
+    static void Begin(char* text)
+    {
+        memset(text, ' ', CELLS);
+    }
+
+    static void Text(char* out, const char* text)
+    {
+        memcpy(out, text, strlen(text));
+    }
+
+    // Fixed number of upper case hex digits
+    static void Hex(char* out, uint32_t value, int digits)
+    {
+        for (int i = digits - 1; i >= 0; i--, value >>= 4)
+            out[i] = HEX[value & 0xF];
+    }
+
+    // Returns the end of the digits
+    static char* Decimal(char* out, uint32_t value)
+    {
+        char digits[10];
+        int count = 0;
+
+        do
+        {
+            digits[count++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+
+        while (count > 0)
+            *out++ = digits[--count];
+
+        return out;
+    }
+
+    bool setLine(int line, const char* text)
+    {
+        if (memcmp(m_Lines[line], text, CELLS) == 0)
+            return false;
+
+        memcpy(m_Lines[line], text, CELLS);
+        BuildLine(line);
+        return true;
+    }
+
+    void BuildLine(int line)
+    {
+        float x = m_Position.x + (line / ROWS) * m_ColumnWidth;
+        float y = m_Position.y + (line % ROWS) * m_LineSpacing + m_Baseline;
+
+        sf::Vertex* quad = &m_Vertices[line * CELLS * 6];
+
+        for (int i = 0; i < CELLS; i++, quad += 6)
+        {
+            int c = (unsigned char)m_Lines[line][i];
+            if (c < FIRST_CHAR || c > LAST_CHAR)
+                c = ' ';
+
+            const CachedGlyph& glyph = m_Glyphs[c - FIRST_CHAR];
+
+            float left = x + glyph.left;
+            float top = y + glyph.top;
+            float right = left + glyph.width;
+            float bottom = top + glyph.height;
+
+            float u1 = glyph.u;
+            float v1 = glyph.v;
+            float u2 = glyph.u + glyph.uWidth;
+            float v2 = glyph.v + glyph.vHeight;
+
+            quad[0] = sf::Vertex(sf::Vector2f(left, top), sf::Color::Black, sf::Vector2f(u1, v1));
+            quad[1] = sf::Vertex(sf::Vector2f(right, top), sf::Color::Black, sf::Vector2f(u2, v1));
+            quad[2] = sf::Vertex(sf::Vector2f(left, bottom), sf::Color::Black, sf::Vector2f(u1, v2));
+            quad[3] = sf::Vertex(sf::Vector2f(left, bottom), sf::Color::Black, sf::Vector2f(u1, v2));
+            quad[4] = sf::Vertex(sf::Vector2f(right, top), sf::Color::Black, sf::Vector2f(u2, v1));
+            quad[5] = sf::Vertex(sf::Vector2f(right, bottom), sf::Color::Black, sf::Vector2f(u2, v2));
+
+            x += glyph.advance;
+        }
+    }
+};
@@ -0,0 +1,54 @@
+#include "decoder.h"
+
+#include <cstddef>
+#include <cstring>
+
+static DecodeTable BuildDecodeTable()
+{
+    DecodeTable table;
+
+    for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++)
+        table[opcode] = DecodeInstruction(static_cast<uint16_t>(opcode));
+
+    return table;
+}
+
+// Filled by a static initializer, a few hundred microseconds at startup.
+// Evaluating 64K decodes as constexpr runs past the default step limits of
+// clang and MSVC
+const DecodeTable g_DecodeTable = BuildDecodeTable();
+
+const char* OpName(Op op)
+{
+    static const char* const names[] =
+    {
+        "Unknown",
+        "00E0", "00EE",
+        "1NNN", "2NNN",
+        "3XNN", "4XNN", "5XY0",
+        "6XNN", "7XNN",
+        "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+        "9XY0",
+        "ANNN", "BNNN", "CXNN", "DXYN",
+        "EX9E", "EXA1",
+        "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65"
+    };
+
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)Op::Count, "One name per Op");
+
+    return op < Op::Count ? names[(int)op] : "Unknown";
+}
+
+bool OpFromName(const char* name, Op& op)
+{
+    for (int i = 0; i < (int)Op::Count; i++)
+    {
+        if (strcmp(name, OpName((Op)i)) == 0)
+        {
+            op = (Op)i;
+            return true;
+        }
+    }
+
+    return false;
+}
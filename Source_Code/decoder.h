@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/*
+// Pre-decoded opcode table
+//
+// Every one of the 65536 possible opcodes is decoded once, during static
+// initialization, into an Instruction, so executing an opcode is a single
+// indexed lookup instead of two nested switches and re-masking X, Y, NN and
+// NNN. The table must not be used from other static initializers.
+*/
+
+enum class Op : uint8_t
+{
+    Unknown,
+
+    Op00E0, Op00EE,
+    Op1NNN, Op2NNN,
+    Op3XNN, Op4XNN, Op5XY0,
+    Op6XNN, Op7XNN,
+    Op8XY0, Op8XY1, Op8XY2, Op8XY3, Op8XY4, Op8XY5, Op8XY6, Op8XY7, Op8XYE,
+    Op9XY0,
+    OpANNN, OpBNNN, OpCXNN, OpDXYN,
+    OpEX9E, OpEXA1,
+    OpFX07, OpFX0A, OpFX15, OpFX18, OpFX1E, OpFX29, OpFX33, OpFX55, OpFX65,
+
+    Count
+};
+
+struct Instruction
+{
+    Op       op;
+    uint8_t  group; // 0xG000
+    uint8_t  x;     // 0x0X00
+    uint8_t  y;     // 0x00Y0
+    uint8_t  n;     // 0x000N
+    uint8_t  nn;    // 0x00NN
+    uint16_t nnn;   // 0x0NNN
+};
+
+// Decodes a single opcode the same way chip8::ExecuteOpcode() does
+constexpr Instruction DecodeInstruction(uint16_t opcode)
+{
+    Instruction in = { Op::Unknown, 0, 0, 0, 0, 0, 0 };
+    in.group = (opcode & 0xF000) >> 12;
+    in.x     = (opcode & 0x0F00) >> 8;
+    in.y     = (opcode & 0x00F0) >> 4;
+    in.n     = opcode & 0x000F;
+    in.nn    = opcode & 0x00FF;
+    in.nnn   = opcode & 0x0FFF;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0: in.op = Op::Op00E0; break;
+                case 0xE: in.op = Op::Op00EE; break;
+            }
+            break;
+        case 0x1000: in.op = Op::Op1NNN; break;
+        case 0x2000: in.op = Op::Op2NNN; break;
+        case 0x3000: in.op = Op::Op3XNN; break;
+        case 0x4000: in.op = Op::Op4XNN; break;
+        case 0x5000: in.op = Op::Op5XY0; break;
+        case 0x6000: in.op = Op::Op6XNN; break;
+        case 0x7000: in.op = Op::Op7XNN; break;
+        case 0x8000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0: in.op = Op::Op8XY0; break;
+                case 0x1: in.op = Op::Op8XY1; break;
+                case 0x2: in.op = Op::Op8XY2; break;
+                case 0x3: in.op = Op::Op8XY3; break;
+                case 0x4: in.op = Op::Op8XY4; break;
+                case 0x5: in.op = Op::Op8XY5; break;
+                case 0x6: in.op = Op::Op8XY6; break;
+                case 0x7: in.op = Op::Op8XY7; break;
+                case 0xE: in.op = Op::Op8XYE; break;
+            }
+            break;
+        case 0x9000: in.op = Op::Op9XY0; break;
+        case 0xA000: in.op = Op::OpANNN; break;
+        case 0xB000: in.op = Op::OpBNNN; break;
+        case 0xC000: in.op = Op::OpCXNN; break;
+        case 0xD000: in.op = Op::OpDXYN; break;
+        case 0xE000:
+            switch (opcode & 0x000F)
+            {
+                case 0xE: in.op = Op::OpEX9E; break;
+                case 0x1: in.op = Op::OpEXA1; break;
+            }
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF)
+            {
+                case 0x07: in.op = Op::OpFX07; break;
+                case 0x0A: in.op = Op::OpFX0A; break;
+                case 0x15: in.op = Op::OpFX15; break;
+                case 0x18: in.op = Op::OpFX18; break;
+                case 0x1E: in.op = Op::OpFX1E; break;
+                case 0x29: in.op = Op::OpFX29; break;
+                case 0x33: in.op = Op::OpFX33; break;
+                case 0x55: in.op = Op::OpFX55; break;
+                case 0x65: in.op = Op::OpFX65; break;
+            }
+            break;
+    }
+
+    return in;
+}
+
+using DecodeTable = std::array<Instruction, 0x10000>;
+
+// Built during static initialization of decoder.cpp, so it must not be used
+// from other static initializers
+extern const DecodeTable g_DecodeTable;
+
+// Opcode pattern like "8XY4", for profiles and traces
+const char* OpName(Op op);
+
+// The Op of a pattern like "8XY4", false for unknown patterns
+bool OpFromName(const char* name, Op& op);
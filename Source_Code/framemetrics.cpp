@@ -0,0 +1,183 @@
+#include "framemetrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+FrameMetrics::FrameMetrics()
+{
+    m_FrameTarget = 1.0 / 60;
+    m_IntervalLength = 1.0;
+    m_Log = nullptr;
+    m_HasPresent = false;
+
+    m_FrameSum = m_FrameMax = 0;
+    for (int i = 0; i < PhaseCount; i++)
+        m_PhaseSum[i] = m_PhaseMax[i] = m_Phase[i] = 0;
+
+    m_IntervalStart = m_FrameStart = m_LastPresent = Clock::now();
+}
+
+FrameMetrics::~FrameMetrics()
+{
+    if (m_Log)
+        fclose(m_Log);
+}
+
+void FrameMetrics::setRefreshRate(double hertz)
+{
+    if (hertz > 0)
+        m_FrameTarget = 1.0 / hertz;
+}
+
+bool FrameMetrics::OpenLog(const std::string& fileName, double intervalSeconds)
+{
+    if (m_Log)
+        fclose(m_Log);
+    m_Log = nullptr;
+
+    if (intervalSeconds > 0)
+        m_IntervalLength = intervalSeconds;
+
+    if (fileName.empty())
+        return true;
+
+    m_Log = fopen(fileName.c_str(), "a");
+    return m_Log != nullptr;
+}
+
+void FrameMetrics::BeginFrame()
+{
+    m_FrameStart = Clock::now();
+
+    for (int i = 0; i < PhaseCount; i++)
+        m_Phase[i] = 0;
+}
+
+void FrameMetrics::EndFrame()
+{
+    Clock::time_point now = Clock::now();
+
+    for (int i = 0; i < PhaseCount; i++)
+    {
+        m_PhaseSum[i] += m_Phase[i];
+        m_PhaseMax[i] = std::max(m_PhaseMax[i], m_Phase[i]);
+    }
+
+    // Present to present, so time spent outside the phases counts too
+    double frame = std::chrono::duration<double>(now - (m_HasPresent ? m_LastPresent : m_FrameStart)).count();
+    m_FrameSum += frame;
+    m_FrameMax = std::max(m_FrameMax, frame);
+
+    // Every vsync interval that passed on top of the one this frame was due in was missed
+    if (m_HasPresent && frame > m_FrameTarget * 1.5)
+    {
+        uint64_t missed = (uint64_t)std::llround(frame / m_FrameTarget) - 1;
+        m_Counters.missedDeadlines += missed;
+        m_Totals.missedDeadlines += missed;
+    }
+
+    m_Counters.frames++;
+    m_Totals.frames++;
+
+    m_LastPresent = now;
+    m_HasPresent = true;
+
+    if (std::chrono::duration<double>(now - m_IntervalStart).count() >= m_IntervalLength)
+        FinishInterval(now);
+}
+
+void FrameMetrics::SkipFrame()
+{
+    Clock::time_point now = Clock::now();
+
+    m_Counters.skippedFrames++;
+    m_Totals.skippedFrames++;
+
+    // Waiting for something to change is not a missed deadline
+    m_HasPresent = false;
+
+    if (std::chrono::duration<double>(now - m_IntervalStart).count() >= m_IntervalLength)
+        FinishInterval(now);
+}
+
+void FrameMetrics::AddTime(Phase phase, Clock::duration time)
+{
+    m_Phase[phase] += std::chrono::duration<double>(time).count();
+}
+
+void FrameMetrics::AddInstructions(uint64_t count)
+{
+    m_Counters.instructions += count;
+    m_Totals.instructions += count;
+}
+
+void FrameMetrics::AddDrawCalls(uint64_t count)
+{
+    m_Counters.drawCalls += count;
+    m_Totals.drawCalls += count;
+}
+
+const FrameMetrics::Counters& FrameMetrics::getTotals()
+{
+    return m_Totals;
+}
+
+const FrameMetrics::Interval& FrameMetrics::getLastInterval()
+{
+    return m_Last;
+}
+
+const char* FrameMetrics::PhaseName(Phase phase)
+{
+    switch (phase)
+    {
+        case Events: return "events";
+        case Emulation: return "emulation";
+        case Drawing: return "drawing";
+        case Text: return "text";
+        case Present: return "present";
+        default: return "unknown";
+    }
+}
+
+/*
+    PRIVATE Functions
+*/
+void FrameMetrics::FinishInterval(Clock::time_point now)
+{
+    double frames = m_Counters.frames > 0 ? (double)m_Counters.frames : 1.0;
+
+    m_Last.counters = m_Counters;
+    m_Last.seconds = std::chrono::duration<double>(now - m_IntervalStart).count();
+    m_Last.frameAverage = m_FrameSum * 1000 / frames;
+    m_Last.frameMax = m_FrameMax * 1000;
+
+    for (int i = 0; i < PhaseCount; i++)
+    {
+        m_Last.phaseAverage[i] = m_PhaseSum[i] * 1000 / frames;
+        m_Last.phaseMax[i] = m_PhaseMax[i] * 1000;
+    }
+
+    if (m_Log)
+    {
+        fprintf(m_Log, "{\"seconds\": %.3f, \"frames\": %llu, \"skippedFrames\": %llu, \"instructions\": %llu, \"missedDeadlines\": %llu, \"drawCalls\": %llu, "
+                       "\"frameMs\": {\"avg\": %.3f, \"max\": %.3f}",
+                m_Last.seconds, (unsigned long long)m_Last.counters.frames, (unsigned long long)m_Last.counters.skippedFrames,
+                (unsigned long long)m_Last.counters.instructions,
+                (unsigned long long)m_Last.counters.missedDeadlines, (unsigned long long)m_Last.counters.drawCalls,
+                m_Last.frameAverage, m_Last.frameMax);
+
+        for (int i = 0; i < PhaseCount; i++)
+            fprintf(m_Log, ", \"%sMs\": {\"avg\": %.3f, \"max\": %.3f}", PhaseName((Phase)i), m_Last.phaseAverage[i], m_Last.phaseMax[i]);
+
+        fprintf(m_Log, "}\n");
+        fflush(m_Log);
+    }
+
+    m_Counters = Counters();
+    m_FrameSum = m_FrameMax = 0;
+    for (int i = 0; i < PhaseCount; i++)
+        m_PhaseSum[i] = m_PhaseMax[i] = 0;
+
+    m_IntervalStart = now;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+// Host frame timeline
+//
+// Scoped timers split every host frame into phases (event polling,
+// emulation, drawing, text layout, present) and counters track instructions,
+// presented frames, missed vsync deadlines and draw calls. Totals and the
+// averages of the last completed interval can be queried, and every interval
+// can be appended to a file as one JSON object per line.
+//
+// Tells whether a slow frame on some machine is spent emulating or presenting.
+*/
+
+class FrameMetrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Phase
+    {
+        Events,     // window event polling
+        Emulation,  // running the guest, rewind and run-ahead
+        Drawing,    // building the pixels
+        Text,       // debug overlay layout
+        Present,    // display(), blocks on vsync
+        PhaseCount
+    };
+
+    // Times the enclosing block as one phase
+    class Scope
+    {
+    public:
+        Scope(FrameMetrics& metrics, Phase phase) : m_Metrics(metrics), m_Phase(phase), m_Start(Clock::now()) {}
+        ~Scope() { m_Metrics.AddTime(m_Phase, Clock::now() - m_Start); }
+
+    private:
+        FrameMetrics& m_Metrics;
+        Phase m_Phase;
+        Clock::time_point m_Start;
+    };
+
+    struct Counters
+    {
+        uint64_t frames = 0;            // presented frames
+        uint64_t skippedFrames = 0;     // loop passes with nothing new to present
+        uint64_t instructions = 0;
+        uint64_t missedDeadlines = 0;   // vsync intervals that passed without a new frame
+        uint64_t drawCalls = 0;
+    };
+
+    // Averages over the last completed interval, in milliseconds
+    struct Interval
+    {
+        Counters counters;
+        double   seconds = 0;
+        double   frameAverage = 0;
+        double   frameMax = 0;
+        double   phaseAverage[PhaseCount] = {};
+        double   phaseMax[PhaseCount] = {};
+    };
+
+public:
+    FrameMetrics();
+    ~FrameMetrics();
+
+    // 60 Hz unless the display is known to be different
+    void setRefreshRate(double hertz);
+
+    // Appends one JSON line per interval to the file, an empty name stops logging
+    bool OpenLog(const std::string& fileName, double intervalSeconds = 1.0);
+
+    // Brackets a host frame, EndFrame() counts it as presented
+    void BeginFrame();
+    void EndFrame();
+
+    // Ends a host frame that presented nothing because nothing changed, the
+    // next present is not measured against the last one
+    void SkipFrame();
+
+    void AddTime(Phase phase, Clock::duration time);
+    void AddInstructions(uint64_t count);
+    void AddDrawCalls(uint64_t count);
+
+    const Counters& getTotals();
+    const Interval& getLastInterval();
+
+    static const char* PhaseName(Phase phase);
+
+private:
+    double m_FrameTarget;       // seconds between vsyncs
+    double m_IntervalLength;
+
+    Counters m_Totals;
+    Interval m_Last;
+
+    // The interval being collected
+    Counters m_Counters;
+    double   m_FrameSum;
+    double   m_FrameMax;
+    double   m_PhaseSum[PhaseCount];
+    double   m_PhaseMax[PhaseCount];
+    double   m_Phase[PhaseCount];       // current frame
+
+    Clock::time_point m_IntervalStart;
+    Clock::time_point m_FrameStart;
+    Clock::time_point m_LastPresent;
+    bool m_HasPresent;
+
+    FILE* m_Log;
+
+private:
+    void FinishInterval(Clock::time_point now);
+};
@@ -0,0 +1,33 @@
+#include "inputscript.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+bool LoadInputScript(const std::string& fileName, std::vector<InputEvent>& events)
+{
+    std::ifstream in(fileName);
+    if (in.fail())
+        return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream ss(line);
+        uint32_t frame, key, pressed;
+        if (!(ss >> frame >> key >> pressed))
+            continue;
+
+        if (key > 0xF)
+            continue;
+
+        events.push_back({ frame, (uint8_t)key, (uint8_t)(pressed != 0) });
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+        [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+
+    return true;
+}
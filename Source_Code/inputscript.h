@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+// Scripted input
+//
+// A text file with one "frame key pressed" triple per line, # starts a
+// comment. Events apply at the start of their frame, before any opcode of
+// that frame runs. Used by the headless tools to drive ROMs reproducibly.
+*/
+
+struct InputEvent
+{
+    uint32_t frame;
+    uint8_t  key;
+    uint8_t  pressed;
+};
+
+// Appends the events of the file sorted by frame, returns false if it can not be read
+bool LoadInputScript(const std::string& fileName, std::vector<InputEvent>& events);
@@ -0,0 +1,674 @@
+#include "jit.h"
+#include "chip8.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define CHIP8_JIT_X64
+
+    #ifdef _WIN32
+        #include <windows.h>
+    #else
+        #include <sys/mman.h>
+    #endif
+#endif
+
+#ifdef CHIP8_JIT_X64
+
+namespace
+{
+    enum HostRegister
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    enum Condition
+    {
+        CC_B  = 0x2,
+        CC_E  = 0x4,
+        CC_NE = 0x5,
+        CC_A  = 0x7
+    };
+
+    // Register-register ALU opcodes, "op dst, src"
+    enum AluOpcode
+    {
+        ALU_ADD = 0x01,
+        ALU_OR  = 0x09,
+        ALU_AND = 0x21,
+        ALU_SUB = 0x29,
+        ALU_XOR = 0x31,
+        ALU_CMP = 0x39,
+        ALU_MOV = 0x89
+    };
+
+    // Opcode extensions for the 0x81 (imm32) and 0xC1 (shift imm8) groups
+    enum AluExtension
+    {
+        EXT_ADD = 0,
+        EXT_AND = 4,
+        EXT_SHL = 4,
+        EXT_SHR = 5,
+        EXT_CMP = 7
+    };
+
+    // Host registers guest registers get mapped to, all saved in the prologue
+    const int s_Pool[] = { RBX, RBP, RSI, R8, R9, R10, R11, R12, R13, R14, R15 };
+    const int s_PoolSize = sizeof(s_Pool) / sizeof(s_Pool[0]);
+
+    // Registers pushed in the prologue, covers the callee saved ones of both ABIs
+    const int s_Saved[] = { RBX, RBP, RSI, RDI, R12, R13, R14, R15 };
+    const int s_SavedCount = sizeof(s_Saved) / sizeof(s_Saved[0]);
+
+    // Guest slots, V0-VF and I
+    const int SLOT_I = 16;
+    const int SLOT_COUNT = 17;
+
+    class Emitter
+    {
+    public:
+        Emitter(uint8_t* code) : m_Code(code), m_Size(0) {}
+
+        size_t Size() { return m_Size; }
+
+        void Push(int r) { Rex(0, r); Byte(0x50 + (r & 7)); }
+        void Pop(int r) { Rex(0, r); Byte(0x58 + (r & 7)); }
+        void Ret() { Byte(0xC3); }
+
+        // mov rdi, rcx
+        void MoveArgumentFromRcx() { Byte(0x48); Byte(0x89); ModRM(3, RCX, RDI); }
+
+        void MovImm(int dst, uint32_t imm) { Rex(0, dst); Byte(0xB8 + (dst & 7)); Dword(imm); }
+        void Alu(AluOpcode op, int dst, int src) { Rex(src, dst); Byte(op); ModRM(3, src, dst); }
+        void AluImm(AluExtension ext, int dst, uint32_t imm) { Rex(0, dst); Byte(0x81); ModRM(3, ext, dst); Dword(imm); }
+        void Shift(AluExtension ext, int dst, uint8_t count) { Rex(0, dst); Byte(0xC1); ModRM(3, ext, dst); Byte(count); }
+        void IMulImm8(int dst, int src, uint8_t imm) { Rex(dst, src); Byte(0x6B); ModRM(3, dst, src); Byte(imm); }
+
+        // dst has to be one of al, cl, dl, bl
+        void SetCC(Condition cc, int dst) { Byte(0x0F); Byte(0x90 | cc); ModRM(3, 0, dst); }
+        void CMovCC(Condition cc, int dst, int src) { Rex(dst, src); Byte(0x0F); Byte(0x40 | cc); ModRM(3, dst, src); }
+
+        // movzx dst, byte/word [rdi + disp]
+        void LoadByte(int dst, int32_t disp) { Rex(dst, RDI); Byte(0x0F); Byte(0xB6); ModRM(2, dst, RDI); Dword(disp); }
+        void LoadWord(int dst, int32_t disp) { Rex(dst, RDI); Byte(0x0F); Byte(0xB7); ModRM(2, dst, RDI); Dword(disp); }
+
+        // mov byte/word [rdi + disp], src - src has to be one of al, cl, dl, bl
+        void StoreByte(int src, int32_t disp) { Byte(0x88); ModRM(2, src, RDI); Dword(disp); }
+        void StoreWord(int src, int32_t disp) { Byte(0x66); Byte(0x89); ModRM(2, src, RDI); Dword(disp); }
+
+    private:
+        uint8_t* m_Code;
+        size_t   m_Size;
+
+        void Byte(uint8_t b) { m_Code[m_Size++] = b; }
+        void Dword(uint32_t d) { for (int i = 0; i < 4; i++) Byte((d >> (i * 8)) & 0xFF); }
+        void ModRM(int mod, int reg, int rm) { Byte((mod << 6) | ((reg & 7) << 3) | (rm & 7)); }
+
+        void Rex(int reg, int rm)
+        {
+            uint8_t rex = 0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0);
+            if (rex != 0x40)
+                Byte(rex);
+        }
+    };
+
+    bool IsSkip(Op op)
+    {
+        return op == Op::Op3XNN || op == Op::Op4XNN || op == Op::Op5XY0 || op == Op::Op9XY0;
+    }
+
+    // Guest slots an opcode touches, returns -1 if it is left to the interpreter
+    int Slots(const Instruction& in, int slots[3])
+    {
+        switch (in.op)
+        {
+            case Op::Op1NNN:
+                return 0;
+
+            case Op::Op3XNN:
+            case Op::Op4XNN:
+            case Op::Op6XNN:
+            case Op::Op7XNN:
+            case Op::OpFX07:
+            case Op::OpFX15:
+            case Op::OpFX18:
+                slots[0] = in.x;
+                return 1;
+
+            case Op::Op5XY0:
+            case Op::Op9XY0:
+            case Op::Op8XY0:
+            case Op::Op8XY1:
+            case Op::Op8XY2:
+            case Op::Op8XY3:
+                slots[0] = in.x;
+                slots[1] = in.y;
+                return 2;
+
+            case Op::Op8XY4:
+            case Op::Op8XY5:
+            case Op::Op8XY7:
+                slots[0] = in.x;
+                slots[1] = in.y;
+                slots[2] = 0xF;
+                return 3;
+
+            case Op::Op8XY6:
+            case Op::Op8XYE:
+                slots[0] = in.x;
+                slots[1] = 0xF;
+                return 2;
+
+            case Op::OpANNN:
+                slots[0] = SLOT_I;
+                return 1;
+
+            case Op::OpFX1E:
+            case Op::OpFX29:
+                slots[0] = in.x;
+                slots[1] = SLOT_I;
+                return 2;
+
+            default:
+                return -1;
+        }
+    }
+
+    struct Compiled
+    {
+        Instruction in;
+        uint16_t    pc;
+    };
+}
+
+Jit::Jit()
+{
+    m_Code = nullptr;
+    m_CodeUsed = 0;
+    m_MapFailed = false;
+
+    m_Empty = false;
+    Flush();
+}
+
+Jit::~Jit()
+{
+    if (!m_Code)
+        return;
+
+#ifdef _WIN32
+    VirtualFree(m_Code, 0, MEM_RELEASE);
+#else
+    munmap(m_Code, CODE_BUFFER_SIZE);
+#endif
+}
+
+bool Jit::Available()
+{
+    if (m_Code || m_MapFailed)
+        return m_Code != nullptr;
+
+    // Executable only once there is code in it
+#ifdef _WIN32
+    m_Code = (uint8_t*)VirtualAlloc(nullptr, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READONLY);
+#else
+    void* code = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code != MAP_FAILED)
+        m_Code = (uint8_t*)code;
+#endif
+
+    m_MapFailed = m_Code == nullptr;
+    return m_Code != nullptr;
+}
+
+unsigned int Jit::Run(chip8& cpu, unsigned int opcodes)
+{
+    if (!Available())
+        return opcodes;
+
+    uint8_t* base = reinterpret_cast<uint8_t*>(&cpu);
+
+    while (opcodes > 0)
+    {
+        uint16_t pc = cpu.m_State.programCounter;
+        if (pc >= 0x1000)
+            break;
+
+        int32_t index = m_BlockAt[pc];
+
+        if (index >= 0)
+        {
+            const CompiledBlock& block = m_Blocks[index];
+
+            // Let the caller single step the rest so the opcode count stays exact
+            if (block.instructionCount > opcodes)
+                break;
+
+            uint32_t result = block.function(base);
+            cpu.m_State.programCounter = result & 0xFFFF;
+            opcodes -= result >> 16;
+            continue;
+        }
+
+        if (index == NOT_COMPILED && ++m_HotCount[pc] >= HOT_THRESHOLD)
+        {
+            Compile(cpu, pc);
+            continue;
+        }
+
+        // Cold code and opcodes the JIT does not handle, can write memory and invalidate
+        cpu.ExecuteDecoded();
+        opcodes--;
+    }
+
+    return opcodes;
+}
+
+void Jit::Invalidate(uint16_t address, uint16_t length)
+{
+    if (m_Empty)
+        return;
+
+    for (uint32_t i = address; i < (uint32_t)address + length && i < 0x1000; i++)
+    {
+        if (m_CodeMap[i])
+        {
+            Flush();
+            return;
+        }
+    }
+}
+
+void Jit::Flush()
+{
+    if (m_Empty)
+        return;
+
+    m_CodeUsed = 0;
+    m_Blocks.clear();
+
+    for (int i = 0; i < 0x1000; i++)
+        m_BlockAt[i] = NOT_COMPILED;
+
+    memset(m_HotCount, 0, sizeof(m_HotCount));
+    memset(m_CodeMap, 0, sizeof(m_CodeMap));
+
+    m_Empty = true;
+}
+
+void Jit::Compile(chip8& cpu, uint16_t address)
+{
+    // Collect the guest instructions of the block first
+    Compiled list[MAX_BLOCK_INSTRUCTIONS + 1];
+    int count = 0;
+
+    int hostOf[SLOT_COUNT];
+    for (int i = 0; i < SLOT_COUNT; i++)
+        hostOf[i] = -1;
+    int used = 0;
+
+    enum { FALLTHROUGH, JUMP, SKIP, SKIP_JUMP } blockExit = FALLTHROUGH;
+    uint16_t pc = address;
+
+    const int memorySize = (int)sizeof(cpu.m_State.memory);
+
+    while (count < MAX_BLOCK_INSTRUCTIONS && pc + 1 < memorySize)
+    {
+        Instruction in = g_DecodeTable[(cpu.m_State.memory[pc] << 8) | cpu.m_State.memory[pc + 1]];
+
+        int slots[3];
+        int slotCount = Slots(in, slots);
+        if (slotCount < 0)
+            break;
+
+        // End the block if the guest registers no longer fit into the pool
+        int needed = 0;
+        for (int i = 0; i < slotCount; i++)
+        {
+            bool seen = hostOf[slots[i]] >= 0;
+            for (int j = 0; j < i; j++)
+                seen = seen || slots[j] == slots[i];
+            if (!seen)
+                needed++;
+        }
+
+        if (used + needed > s_PoolSize)
+            break;
+
+        for (int i = 0; i < slotCount; i++)
+            if (hostOf[slots[i]] < 0)
+                hostOf[slots[i]] = s_Pool[used++];
+
+        list[count].in = in;
+        list[count].pc = pc;
+        count++;
+
+        if (in.op == Op::Op1NNN)
+        {
+            // Follow the jump unless it loops back into this block
+            bool visited = false;
+            for (int i = 0; i < count && !visited; i++)
+                visited = list[i].pc == in.nnn;
+
+            if (visited || count >= MAX_BLOCK_INSTRUCTIONS || in.nnn + 1 >= memorySize)
+            {
+                blockExit = JUMP;
+                break;
+            }
+
+            pc = in.nnn;
+            continue;
+        }
+
+        if (IsSkip(in.op))
+        {
+            blockExit = SKIP;
+
+            // skip + jump is a conditional branch
+            if (pc + 3 < memorySize)
+            {
+                Instruction next = g_DecodeTable[(cpu.m_State.memory[pc + 2] << 8) | cpu.m_State.memory[pc + 3]];
+                if (next.op == Op::Op1NNN)
+                {
+                    list[count].in = next;
+                    list[count].pc = pc + 2;
+                    blockExit = SKIP_JUMP;
+                }
+            }
+            break;
+        }
+
+        pc += 2;
+    }
+
+    if (count == 0)
+    {
+        m_BlockAt[address] = NOT_COMPILABLE;
+        return;
+    }
+
+    // Worst case code size, start over when the buffer is full
+    size_t maxSize = (size_t)count * 64 + SLOT_COUNT * 16 + 128;
+    if (m_CodeUsed + maxSize > CODE_BUFFER_SIZE)
+        Flush();
+
+    if (!Protect(true))
+    {
+        m_BlockAt[address] = NOT_COMPILABLE;
+        return;
+    }
+
+    uint8_t* start = m_Code + m_CodeUsed;
+    Emitter e(start);
+
+    const int32_t offsetV = (int32_t)(cpu.m_State.registers - reinterpret_cast<uint8_t*>(&cpu));
+    const int32_t offsetI = (int32_t)(reinterpret_cast<uint8_t*>(&cpu.m_State.addressI) - reinterpret_cast<uint8_t*>(&cpu));
+    const int32_t offsetDelay = (int32_t)(&cpu.m_State.delayTimer - reinterpret_cast<uint8_t*>(&cpu));
+    const int32_t offsetSound = (int32_t)(&cpu.m_State.soundTimer - reinterpret_cast<uint8_t*>(&cpu));
+
+    // Prologue, load every guest register the block uses
+    for (int i = 0; i < s_SavedCount; i++)
+        e.Push(s_Saved[i]);
+
+#ifdef _WIN32
+    e.MoveArgumentFromRcx();
+#endif
+
+    for (int slot = 0; slot < SLOT_COUNT; slot++)
+    {
+        if (hostOf[slot] < 0)
+            continue;
+
+        if (slot == SLOT_I)
+            e.LoadWord(hostOf[slot], offsetI);
+        else
+            e.LoadByte(hostOf[slot], offsetV + slot);
+    }
+
+    bool dirty[SLOT_COUNT] = {};
+
+    // Body, same semantics as chip8::Execute()
+    int body = (blockExit == SKIP || blockExit == SKIP_JUMP || blockExit == JUMP) ? count - 1 : count;
+    for (int i = 0; i < body; i++)
+    {
+        const Instruction& in = list[i].in;
+        int x = hostOf[in.x];
+        int y = hostOf[in.y];
+        int f = hostOf[0xF];
+        int I = hostOf[SLOT_I];
+
+        switch (in.op)
+        {
+            case Op::Op1NNN:
+                // Followed jump, nothing to do
+                break;
+
+            case Op::Op6XNN: e.MovImm(x, in.nn); dirty[in.x] = true; break;
+
+            case Op::Op7XNN:
+                e.AluImm(EXT_ADD, x, in.nn);
+                e.AluImm(EXT_AND, x, 0xFF);
+                dirty[in.x] = true;
+                break;
+
+            case Op::Op8XY0: e.Alu(ALU_MOV, x, y); dirty[in.x] = true; break;
+            case Op::Op8XY1: e.Alu(ALU_OR, x, y); dirty[in.x] = true; break;
+            case Op::Op8XY2: e.Alu(ALU_AND, x, y); dirty[in.x] = true; break;
+            case Op::Op8XY3: e.Alu(ALU_XOR, x, y); dirty[in.x] = true; break;
+
+            case Op::Op8XY4:
+                e.MovImm(f, 0);
+                e.Alu(ALU_MOV, RAX, x);
+                e.Alu(ALU_ADD, RAX, y);
+                e.Alu(ALU_XOR, RCX, RCX);
+                e.AluImm(EXT_CMP, RAX, 255);
+                e.SetCC(CC_A, RCX);
+                e.Alu(ALU_MOV, f, RCX);
+                e.Alu(ALU_MOV, RAX, x);
+                e.Alu(ALU_ADD, RAX, y);
+                e.AluImm(EXT_AND, RAX, 0xFF);
+                e.Alu(ALU_MOV, x, RAX);
+                dirty[in.x] = dirty[0xF] = true;
+                break;
+
+            case Op::Op8XY5:
+            case Op::Op8XY7:
+                e.MovImm(f, 0);
+                e.Alu(ALU_MOV, RAX, x);
+                e.Alu(ALU_MOV, RDX, y);
+                e.Alu(ALU_XOR, RCX, RCX);
+                e.Alu(ALU_CMP, RAX, RDX);
+                e.SetCC(in.op == Op::Op8XY5 ? CC_A : CC_B, RCX);
+                e.Alu(ALU_MOV, f, RCX);
+                if (in.op == Op::Op8XY5)
+                {
+                    e.Alu(ALU_SUB, RAX, RDX);
+                    e.AluImm(EXT_AND, RAX, 0xFF);
+                    e.Alu(ALU_MOV, x, RAX);
+                }
+                else
+                {
+                    e.Alu(ALU_SUB, RDX, RAX);
+                    e.AluImm(EXT_AND, RDX, 0xFF);
+                    e.Alu(ALU_MOV, x, RDX);
+                }
+                dirty[in.x] = dirty[0xF] = true;
+                break;
+
+            case Op::Op8XY6:
+                e.Alu(ALU_MOV, RAX, x);
+                e.AluImm(EXT_AND, RAX, 1);
+                e.Alu(ALU_MOV, f, RAX);
+                e.Shift(EXT_SHR, x, 1);
+                dirty[in.x] = dirty[0xF] = true;
+                break;
+
+            case Op::Op8XYE:
+                e.Alu(ALU_MOV, RAX, x);
+                e.Shift(EXT_SHR, RAX, 7);
+                e.Alu(ALU_MOV, f, RAX);
+                e.Shift(EXT_SHL, x, 1);
+                e.AluImm(EXT_AND, x, 0xFF);
+                dirty[in.x] = dirty[0xF] = true;
+                break;
+
+            case Op::OpANNN: e.MovImm(I, in.nnn); dirty[SLOT_I] = true; break;
+
+            case Op::OpFX07: e.LoadByte(x, offsetDelay); dirty[in.x] = true; break;
+
+            case Op::OpFX15:
+            case Op::OpFX18:
+                e.Alu(ALU_MOV, RCX, x);
+                e.StoreByte(RCX, in.op == Op::OpFX15 ? offsetDelay : offsetSound);
+                break;
+
+            case Op::OpFX1E:
+                e.Alu(ALU_ADD, I, x);
+                e.AluImm(EXT_AND, I, 0xFFFF);
+                dirty[SLOT_I] = true;
+                break;
+
+            case Op::OpFX29: e.IMulImm8(I, x, 5); dirty[SLOT_I] = true; break;
+
+            default:
+                break;
+        }
+    }
+
+    // Exit, the next program counter and instruction count go to eax
+    const Compiled& last = list[count - 1];
+    uint32_t executed = (uint32_t)count << 16;
+
+    switch (blockExit)
+    {
+        case FALLTHROUGH:
+            // pc is the first instruction that was not compiled
+            e.MovImm(RAX, pc | executed);
+            break;
+
+        case JUMP:
+            e.MovImm(RAX, last.in.nnn | executed);
+            break;
+
+        case SKIP:
+        case SKIP_JUMP:
+        {
+            const Instruction& in = last.in;
+            bool equal = in.op == Op::Op3XNN || in.op == Op::Op5XY0;
+
+            // eax = not taken, edx = taken
+            if (blockExit == SKIP)
+                e.MovImm(RAX, (last.pc + 2) | executed);
+            else
+                e.MovImm(RAX, list[count].in.nnn | (executed + 0x10000));
+            e.MovImm(RDX, (last.pc + 4) | executed);
+
+            if (in.op == Op::Op3XNN || in.op == Op::Op4XNN)
+                e.AluImm(EXT_CMP, hostOf[in.x], in.nn);
+            else
+                e.Alu(ALU_CMP, hostOf[in.x], hostOf[in.y]);
+
+            e.CMovCC(equal ? CC_E : CC_NE, RAX, RDX);
+            break;
+        }
+    }
+
+    // Write back modified guest registers, mov does not touch eax or the flags
+    for (int slot = 0; slot < SLOT_COUNT; slot++)
+    {
+        if (!dirty[slot])
+            continue;
+
+        e.Alu(ALU_MOV, RCX, hostOf[slot]);
+
+        if (slot == SLOT_I)
+            e.StoreWord(RCX, offsetI);
+        else
+            e.StoreByte(RCX, offsetV + slot);
+    }
+
+    for (int i = s_SavedCount - 1; i >= 0; i--)
+        e.Pop(s_Saved[i]);
+
+    e.Ret();
+
+    m_CodeUsed += e.Size();
+
+    if (!Protect(false))
+    {
+        // Not runnable, the block stays interpreted
+        m_BlockAt[address] = NOT_COMPILABLE;
+        return;
+    }
+
+#ifdef _WIN32
+    FlushInstructionCache(GetCurrentProcess(), start, e.Size());
+#endif
+
+    // Remember which guest bytes the block was compiled from
+    int instructionCount = blockExit == SKIP_JUMP ? count + 1 : count;
+    for (int i = 0; i < instructionCount; i++)
+        m_CodeMap[list[i].pc] = m_CodeMap[list[i].pc + 1] = 1;
+
+    CompiledBlock block;
+    block.function = reinterpret_cast<BlockFunction>(start);
+    block.instructionCount = (uint16_t)instructionCount;
+
+    m_Empty = false;
+    m_BlockAt[address] = (int32_t)m_Blocks.size();
+    m_Blocks.push_back(block);
+}
+
+bool Jit::Protect(bool writable)
+{
+#ifdef _WIN32
+    DWORD previous;
+    return VirtualProtect(m_Code, CODE_BUFFER_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &previous) != 0;
+#else
+    return mprotect(m_Code, CODE_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+#else
+
+Jit::Jit()
+{
+    m_Code = nullptr;
+    m_CodeUsed = 0;
+    m_MapFailed = true;
+    m_Empty = true;
+}
+
+Jit::~Jit()
+{
+}
+
+bool Jit::Available()
+{
+    return false;
+}
+
+unsigned int Jit::Run(chip8& cpu, unsigned int opcodes)
+{
+    return opcodes;
+}
+
+void Jit::Invalidate(uint16_t address, uint16_t length)
+{
+}
+
+void Jit::Flush()
+{
+}
+
+void Jit::Compile(chip8& cpu, uint16_t address)
+{
+}
+
+bool Jit::Protect(bool writable)
+{
+    return false;
+}
+
+#endif // CHIP8_JIT_X64
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "decoder.h"
+
+/*
+// x86-64 dynamic recompiler
+//
+// Guest blocks that are executed often are compiled to native code in an
+// executable buffer. Within a block the guest registers V0-VF and I live in
+// host registers, they are loaded on entry and only the modified ones are
+// written back on exit. Opcodes that draw, wait, read keys, touch the stack
+// or memory are left to the interpreter, a block simply ends before them.
+// Any guest memory write into compiled code throws all compiled code away.
+//
+// The code buffer is only mapped once the JIT is used, and it is never
+// writable and executable at once: Compile makes it writable while emitting
+// a block and executable again before that runs.
+//
+// On other architectures, or when executable memory can not be allocated,
+// Available() returns false and chip8 falls back to the decoded interpreter.
+*/
+
+class chip8;
+
+class Jit
+{
+public:
+    Jit();
+    ~Jit();
+
+    // Owns the code buffer
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+    Jit(Jit&&) = delete;
+    Jit& operator=(Jit&&) = delete;
+
+    // Maps the code buffer on first use
+    bool Available();
+
+    // Runs compiled blocks and interprets the rest,
+    // returns how many opcodes are still to be executed
+    unsigned int Run(chip8& cpu, unsigned int opcodes);
+
+    void Invalidate(uint16_t address, uint16_t length);
+    void Flush();
+
+private:
+    // Returns the next program counter in the low 16 bits
+    // and the number of executed guest instructions in the high 16 bits
+    typedef uint32_t (*BlockFunction)(uint8_t* cpu);
+
+    struct CompiledBlock
+    {
+        BlockFunction function;
+        uint16_t      instructionCount; // upper bound
+    };
+
+    static const int    MAX_BLOCK_INSTRUCTIONS = 64;
+    static const int    HOT_THRESHOLD = 8;
+    static const size_t CODE_BUFFER_SIZE = 1 << 20;
+
+    static const int32_t NOT_COMPILED = -1;
+    static const int32_t NOT_COMPILABLE = -2;
+
+    uint8_t* m_Code;
+    size_t   m_CodeUsed;
+    bool     m_MapFailed;   // not tried again
+
+    std::vector<CompiledBlock> m_Blocks;
+
+    int32_t m_BlockAt[0x1000];  // block index per start address or NOT_COMPILED / NOT_COMPILABLE
+    uint8_t m_HotCount[0x1000];
+    uint8_t m_CodeMap[0x1000];  // 1 if the byte belongs to a compiled block
+    bool    m_Empty;
+
+private:
+    void Compile(chip8& cpu, uint16_t address);
+
+    // Switches the code buffer between read/write and read/execute
+    bool Protect(bool writable);
+};
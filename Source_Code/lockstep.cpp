@@ -0,0 +1,194 @@
+#include "lockstep.h"
+
+#include <algorithm>
+#include <cstring>
+
+LockstepVerifier::LockstepVerifier(const std::vector<uint8_t>& rom, const Settings& settings, const std::vector<InputEvent>& input)
+    : m_Rom(rom), m_Settings(settings), m_Input(input)
+{
+    if (m_Settings.opcodesPerFrame == 0)
+        m_Settings.opcodesPerFrame = 1;
+
+    if (m_Settings.interval == 0)
+        m_Settings.interval = 1;
+
+    m_Executed = 0;
+    m_Frame = 0;
+    m_FrameOpcodes = 0;
+    m_NextEvent = 0;
+}
+
+bool LockstepVerifier::Run()
+{
+    Reset();
+
+    uint64_t lastGood = 0;
+    while (m_Frame < m_Settings.frames)
+    {
+        Step(m_Settings.interval);
+
+        if (!SameState(*m_Reference, *m_Candidate))
+        {
+            Pinpoint(lastGood);
+            return false;
+        }
+
+        lastGood = m_Executed;
+    }
+
+    return true;
+}
+
+uint64_t LockstepVerifier::getExecuted()
+{
+    return m_Executed;
+}
+
+void LockstepVerifier::Reset()
+{
+    m_Reference.reset(new chip8());
+    m_Candidate.reset(new chip8());
+
+    m_Reference->setEngine(chip8::Engine::Interpreter);
+    m_Candidate->setEngine(m_Settings.engine);
+
+    m_Reference->setSeed(m_Settings.seed);
+    m_Candidate->setSeed(m_Settings.seed);
+
+    m_Reference->loadRom(m_Rom.data(), m_Rom.size());
+    m_Candidate->loadRom(m_Rom.data(), m_Rom.size());
+
+    m_Executed = 0;
+    m_Frame = 0;
+    m_FrameOpcodes = 0;
+    m_NextEvent = 0;
+}
+
+void LockstepVerifier::Step(uint64_t opcodes)
+{
+    // Same frame structure as the App: input, a batch of opcodes, timers
+    while (opcodes > 0 && m_Frame < m_Settings.frames)
+    {
+        if (m_FrameOpcodes == 0)
+        {
+            for (; m_NextEvent < m_Input.size() && m_Input[m_NextEvent].frame <= m_Frame; m_NextEvent++)
+            {
+                const InputEvent& e = m_Input[m_NextEvent];
+
+                if (e.pressed)
+                {
+                    m_Reference->KeyPressed(e.key);
+                    m_Candidate->KeyPressed(e.key);
+                }
+                else
+                {
+                    m_Reference->KeyReleased(e.key);
+                    m_Candidate->KeyReleased(e.key);
+                }
+            }
+        }
+
+        uint32_t count = (uint32_t)std::min<uint64_t>(opcodes, m_Settings.opcodesPerFrame - m_FrameOpcodes);
+
+        m_Reference->Run(count);
+        m_Candidate->Run(count);
+
+        m_FrameOpcodes += count;
+        m_Executed += count;
+        opcodes -= count;
+
+        if (m_FrameOpcodes == m_Settings.opcodesPerFrame)
+        {
+            m_Reference->DecreaseTimers();
+            m_Candidate->DecreaseTimers();
+
+            m_FrameOpcodes = 0;
+            m_Frame++;
+        }
+    }
+}
+
+void LockstepVerifier::Pinpoint(uint64_t lastGood)
+{
+    uint64_t failed = m_Executed;
+
+    // Replaying is deterministic, so the checkpoint can be reached again from boot
+    Reset();
+    Step(lastGood);
+
+    while (m_Executed < failed)
+    {
+        uint16_t pc = m_Reference->m_State.programCounter;
+        uint16_t opcode = (m_Reference->m_State.memory[pc & 0xFFF] << 8) | m_Reference->m_State.memory[(pc + 1) & 0xFFF];
+
+        Step(1);
+
+        if (!SameState(*m_Reference, *m_Candidate))
+        {
+            printf("Divergence at instruction %llu (frame %u), PC 0x%03X opcode 0x%04X\n",
+                (unsigned long long)m_Executed, m_Frame, pc, opcode);
+            Report();
+            return;
+        }
+    }
+
+    // The candidate only goes wrong when it runs larger batches, e.g. inside a compiled block
+    printf("Divergence between instruction %llu and %llu, not reproducible by single stepping\n",
+        (unsigned long long)lastGood, (unsigned long long)failed);
+
+    Reset();
+    Step(failed);
+    Report();
+}
+
+void LockstepVerifier::Report()
+{
+    const chip8& a = *m_Reference;
+    const chip8& b = *m_Candidate;
+
+    PrintState("reference", a);
+    PrintState(chip8::EngineName(m_Settings.engine), b);
+
+    for (int i = 0; i < (int)sizeof(a.m_State.memory); i++)
+    {
+        if (a.m_State.memory[i] != b.m_State.memory[i])
+        {
+            printf("  memory differs at 0x%03X: %02X / %02X\n", i, a.m_State.memory[i], b.m_State.memory[i]);
+            break;
+        }
+    }
+
+    for (int y = 0; y < 32; y++)
+    {
+        uint64_t diff = a.m_State.screen[y] ^ b.m_State.screen[y];
+        if (diff)
+        {
+            int x = 0;
+            while (!(diff & (0x8000000000000000ull >> x)))
+                x++;
+
+            printf("  screen differs at %d,%d\n", x, y);
+            break;
+        }
+    }
+
+    if (a.m_State.stackPointer != b.m_State.stackPointer || memcmp(a.m_State.stack, b.m_State.stack, sizeof(a.m_State.stack)) != 0)
+        printf("  stack differs\n");
+}
+
+bool LockstepVerifier::SameState(const chip8& a, const chip8& b)
+{
+    // Registers, I, PC, stack, timers, memory and screen are all in the state block
+    return memcmp(&a.m_State, &b.m_State, sizeof(chip8State)) == 0;
+}
+
+void LockstepVerifier::PrintState(const char* name, const chip8& cpu)
+{
+    printf("  %-12s PC %03X I %03X SP %d DT %02X ST %02X V",
+        name, cpu.m_State.programCounter, cpu.m_State.addressI, cpu.m_State.stackPointer, cpu.m_State.delayTimer, cpu.m_State.soundTimer);
+
+    for (int i = 0; i < 16; i++)
+        printf(" %02X", cpu.m_State.registers[i]);
+
+    printf("\n");
+}
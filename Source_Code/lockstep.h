@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "inputscript.h"
+
+/*
+// Lockstep differential verification
+//
+// Runs the reference interpreter (chip8::ExecuteOpcode) and a candidate engine
+// side by side with the same ROM, seed and scripted input, and compares the
+// whole machine state every interval instructions. On a mismatch both machines
+// are replayed from boot to the last matching checkpoint and single stepped
+// to find the first diverging instruction.
+*/
+
+class LockstepVerifier
+{
+public:
+    struct Settings
+    {
+        chip8::Engine engine = chip8::Engine::Decoded;
+        uint32_t      frames = 3600;
+        uint32_t      opcodesPerFrame = 800 / 60;
+        uint32_t      interval = 1000;  // instructions between state compares
+        uint32_t      seed = 1;
+    };
+
+public:
+    LockstepVerifier(const std::vector<uint8_t>& rom, const Settings& settings, const std::vector<InputEvent>& input);
+
+    // Returns true if the candidate matched the reference for the whole run
+    bool Run();
+
+    uint64_t getExecuted();
+
+private:
+    std::vector<uint8_t>    m_Rom;
+    Settings                m_Settings;
+    std::vector<InputEvent> m_Input;
+
+    std::unique_ptr<chip8>  m_Reference;
+    std::unique_ptr<chip8>  m_Candidate;
+
+    uint64_t m_Executed;
+    uint32_t m_Frame;
+    uint32_t m_FrameOpcodes;
+    size_t   m_NextEvent;
+
+private:
+    void Reset();
+    void Step(uint64_t opcodes);
+
+    void Pinpoint(uint64_t lastGood);
+    void Report();
+
+    static bool SameState(const chip8& a, const chip8& b);
+    static void PrintState(const char* name, const chip8& cpu);
+};
@@ -1,36 +1,129 @@
 #include "mihaSimpleSFML.h"
 #include "chip8.h"
-
+#include "savestate.h"
+#include "rewind.h"
+#include "movie.h"
+#include "scheduler.h"
+#include "spscqueue.h"
+#include "triplebuffer.h"
+#include "debugoverlay.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
 #include <fstream>
-#include <iomanip>
-#include <sstream>
+#include <thread>
 
 class App : public mihaSimpleSFML
 {
 public:
-    App()
+    // Up to 10 minutes of history in 4 MB
+    App() : m_Rewind(4 << 20, 60 * 60 * 10)
     {
+        m_Rewinding = false;
+        m_Turbo = false;
+        m_TurboSpeed = 0.0f;
+        m_EmulationRunning = false;
+        m_ShownInstructions = 0;
+        m_ShownEmulationTime = EmulationClock::duration::zero();
+
+        m_RunAhead = 0;
+        m_HiddenFrames = 0;
+        m_RunAheadFrames = 0;
+        m_RunAheadMicroseconds = 0;
+        m_RunAheadCost = 0.0f;
+
+        // RGB stays black, only the alpha of a pixel changes
+        memset(m_screenPixels, 0, sizeof(m_screenPixels));
+        memset(m_shownRows, 0, sizeof(m_shownRows));
+        m_screenUploaded = false;
+        m_overlayVisible = true;
+        m_Changed = true;
+
         // Try and load settings.ini if it exists
         std::ifstream in("settings.ini");
         if (!in.fail())
         {
             std::string line;
 
-            while (!in.eof())
+            while (in >> line)
             {
-                in >> line;
-
                 if (line == "Rom")
                 {
                     in >> m_romName;
                 }
 
-                if (line == "OpcodesPerFrame")
+                // Despite the name the opcodes per second, the same as ClockRate
+                // while every opcode costs one cycle
+                if (line == "OpcodesPerFrame" || line == "ClockRate")
+                {
+                    uint32_t rate = 0;
+                    in >> rate;
+                    m_Scheduler.setClockRate(rate);
+
+                    std::cout << "Loaded custom " << line << "\n";
+                }
+
+                // CycleCost DXYN 4 makes every DXYN take 4 cycles, the rest stays at 1
+                if (line == "CycleCost")
+                {
+                    std::string name;
+                    uint32_t cycles = 1;
+                    in >> name >> cycles;
+
+                    Op op;
+                    if (OpFromName(name.c_str(), op))
+                        m_Scheduler.setCost(op, cycles);
+                    else
+                        std::cout << "Unknown opcode " << name << "\n";
+                }
+
+                // Multiple of real time while turbo is on, 0 runs as fast as the host allows
+                if (line == "TurboSpeed")
+                {
+                    in >> m_TurboSpeed;
+                }
+
+                if (line == "RunAhead")
+                {
+                    in >> m_RunAhead;
+
+                    std::cout << "Running " << m_RunAhead << " frames ahead\n";
+                }
+
+                if (line == "MetricsLog")
+                {
+                    std::string name;
+                    in >> name;
+
+                    // One JSON line of frame timings per second
+                    if (!getMetrics().OpenLog(name))
+                        std::cout << "Could not open " << name << "\n";
+                }
+
+                // Records the input from power-on, written when the window closes
+                if (line == "RecordMovie")
+                {
+                    in >> m_RecordMovieName;
+                }
+
+                // Plays a recorded movie instead of the rom, keys are ignored until it ends
+                if (line == "PlayMovie")
                 {
-                    in >> m_OpcodesPerFrame;
-                    m_OpcodesPerFrame /= 60;
+                    in >> m_PlayMovieName;
+                }
 
-                    std::cout << "Loaded custom OpcodesPerFrame\n";
+                if (line == "Engine")
+                {
+                    std::string name;
+                    in >> name;
+
+                    chip8::Engine engine;
+                    if (chip8::EngineFromName(name, engine))
+                        m_emulator.setEngine(engine);
+                    else
+                        std::cout << "Unknown engine " << name << "\n";
                 }
             }
         }
@@ -38,49 +131,154 @@ public:
         {
             std::cout << "Could not open settings.ini\n";
 
-            // Default speed --> opcodes / FPS = opcodes per frame
-            m_OpcodesPerFrame = 400 / 60;
+            // Default speed in opcodes per second
+            m_Scheduler.setClockRate(400);
+        }
+    }
+
+    ~App()
+    {
+        // Everything below belongs to the emulation thread until it stopped
+        if (m_EmulationThread.joinable())
+        {
+            m_EmulationRunning = false;
+            m_EmulationThread.join();
+        }
+
+        if (m_Recorder.isRecording())
+        {
+            if (m_Recorder.Stop(m_RecordMovieName))
+                std::cout << "Saved movie " << m_RecordMovieName << "\n";
+            else
+                std::cout << "Could not write movie " << m_RecordMovieName << "\n";
         }
+
+#ifdef CHIP8_PROFILE
+        // Profiling builds leave the histogram and the flamegraph input next to the rom
+        m_emulator.getProfiler().WriteHistogram(m_romName + ".profile.txt");
+        m_emulator.getProfiler().WriteFoldedStacks(m_romName + ".folded");
+#endif
     }
 
 private:
+    using EmulationClock = std::chrono::steady_clock;
+
+    // Render thread to emulation thread, stamped when the window reported them
+    struct HostCommand
+    {
+        enum Type : uint8_t { KeyDown, KeyUp, RewindOn, RewindOff, Save, Load, Turbo };
+
+        Type                       type;
+        uint8_t                    key;
+        EmulationClock::time_point time;
+    };
+
+    // Emulation thread to render thread, once per emulated frame
+    struct EmulatedFrame
+    {
+        chip8State                 state;
+        uint64_t                   rows[32];            // run-ahead screen when enabled
+        uint64_t                   instructions;        // totals since the start
+        EmulationClock::duration   emulationTime;
+        uint64_t                   hiddenFrames;
+        float                      runAheadCost;
+        bool                       idle;                // waiting for a key or the delay timer
+        bool                       turbo;
+        float                      speed;               // achieved multiple of real time
+    };
+
+    // Input is applied this far into the frame after it arrived, a quarter frame at most
+    static const int SLICES_PER_FRAME = 4;
+
+    std::thread                              m_EmulationThread;
+    std::atomic<bool>                        m_EmulationRunning;
+    SpscQueue<HostCommand, 256>              m_Commands;
+    TripleBuffer<EmulatedFrame>              m_Frames;
+
+    // Render thread side of the frame totals, for the metrics
+    uint64_t                                 m_ShownInstructions;
+    EmulationClock::duration                 m_ShownEmulationTime;
+
+    // Owned by the emulation thread once it started
     chip8           m_emulator;
 
-    unsigned int    m_OpcodesPerFrame;
+    CycleScheduler  m_Scheduler;
     std::string     m_romName;
 
+    RewindBuffer    m_Rewind;
+    bool            m_Rewinding;
+
+    // Frames run back to back or at TurboSpeed times 60 Hz, only the ones the
+    // render thread can show are handed to it
+    bool            m_Turbo;
+    float           m_TurboSpeed;
+
+    Movie           m_Movie;
+    MoviePlayer     m_Player;
+    MovieRecorder   m_Recorder;
+    std::string     m_PlayMovieName;
+    std::string     m_RecordMovieName;
+
+    // Frames emulated ahead and thrown away each frame to hide input latency
+    unsigned int    m_RunAhead;
+    uint64_t        m_HiddenFrames;
+    unsigned int    m_RunAheadFrames;
+    int64_t         m_RunAheadMicroseconds;
+    float           m_RunAheadCost;         // ms per frame, averaged over a second
+
     sf::Font        m_font;
-    sf::Text        m_text;
+
+    // Registers, stack, timers and keys of the shown frame, F1 hides it
+    DebugOverlay    m_overlay;
+    bool            m_overlayVisible;
+
+    // The guest screen is one 64x32 texture drawn as a single scaled sprite
+    sf::Texture     m_screenTexture;
+    sf::Sprite      m_screenSprite;
+    sf::Uint8       m_screenPixels[64 * 32 * 4];
+    uint64_t        m_shownRows[32];        // rows the texture holds
+    bool            m_screenUploaded;
+    bool            m_Changed;              // the window shows an older frame
 
 private:
-    void DrawPixel(int x, int y, int width)
+    // Rewinding and loading states would leave the recorded timeline
+    bool MovieActive()
     {
-        sf::RectangleShape pixel;
-        pixel.setSize(sf::Vector2f(width, width));
-        pixel.setPosition(x, y);
-        pixel.setFillColor(sf::Color::Black);
-
-        Draw(pixel);
+        return m_Recorder.isRecording() || m_Player.isPlaying();
     }
 
-    void DumpRegisters()
+    void DrawScreen(const uint64_t* rows)
     {
-        std::string string;
-
-        for (int i = 0x0; i <= 0xF; i++)
+        // Converts and uploads only when the guest changed a pixel
+        if (!m_screenUploaded || memcmp(rows, m_shownRows, sizeof(m_shownRows)) != 0)
         {
-            std::stringstream ss;
-            ss << std::hex << std::uppercase << i;
+            for (int y = 0; y < 32; y++)
+            {
+                if (m_screenUploaded && rows[y] == m_shownRows[y])
+                    continue;
 
-            std::stringstream ss2;
-            ss2 << "0x" << std::hex << std::uppercase << (int)m_emulator.getRegister(i);
+                // Lit pixels are opaque black, the rest lets the background through
+                sf::Uint8* alpha = &m_screenPixels[y * 64 * 4 + 3];
+                for (int x = 0; x < 64; x++, alpha += 4)
+                    *alpha = ((rows[y] >> (63 - x)) & 1) ? 255 : 0;
+            }
 
-            string += "V" + ss.str() + "  " + ss2.str() + "\n";
+            m_screenTexture.update(m_screenPixels);
+            memcpy(m_shownRows, rows, sizeof(m_shownRows));
+            m_screenUploaded = true;
         }
 
-        m_text.setString(string);
+        Draw(m_screenSprite);
+    }
+
+    // Formats the overlay only while it is shown, returns whether a line changed
+    bool UpdateOverlay(const EmulatedFrame& frame)
+    {
+        if (!m_overlayVisible)
+            return false;
 
-        Draw(m_text);
+        DebugOverlay::Status status = { frame.idle, frame.turbo, frame.speed, m_RunAhead, frame.runAheadCost };
+        return m_overlay.Update(frame.state, status);
     }
 
 private:
@@ -88,6 +286,44 @@ private:
     {
         if (e.type == sf::Event::KeyPressed)
         {
+            // Backspace held down steps back one frame per frame
+            if (e.key.code == sf::Keyboard::Backspace)
+            {
+                SendCommand(HostCommand::RewindOn);
+                return;
+            }
+
+            // Tab switches turbo on and off
+            if (e.key.code == sf::Keyboard::Tab)
+            {
+                SendCommand(HostCommand::Turbo);
+                return;
+            }
+
+            // F1 shows and hides the debug overlay, hidden it is neither formatted nor drawn
+            if (e.key.code == sf::Keyboard::F1)
+            {
+                m_overlayVisible = !m_overlayVisible;
+
+                // Catch up on the frames that went by while it was hidden
+                UpdateOverlay(m_Frames.getFront());
+                m_Changed = true;
+                return;
+            }
+
+            // F5 saves, F9 loads the state next to the rom name
+            if (e.key.code == sf::Keyboard::F5)
+            {
+                SendCommand(HostCommand::Save);
+                return;
+            }
+
+            if (e.key.code == sf::Keyboard::F9)
+            {
+                SendCommand(HostCommand::Load);
+                return;
+            }
+
             int key = -1;
 
             switch (e.key.code)
@@ -116,10 +352,16 @@ private:
 
 
             if (key != -1)
-                m_emulator.KeyPressed(key);
+                SendCommand(HostCommand::KeyDown, key);
         }
         else if (e.type == sf::Event::KeyReleased)
         {
+            if (e.key.code == sf::Keyboard::Backspace)
+            {
+                SendCommand(HostCommand::RewindOff);
+                return;
+            }
+
             int key = -1;
 
             switch (e.key.code)
@@ -147,7 +389,7 @@ private:
             #endif // DEBUG
 
             if (key != -1)
-                m_emulator.KeyReleased(key);
+                SendCommand(HostCommand::KeyUp, key);
         }
     }
 
@@ -159,48 +401,365 @@ private:
         {
             // error
         }
-        else m_text.setFont(m_font);
-
-        m_text.setCharacterSize(16);
-        m_text.setPosition(650, 20);
-        m_text.setOutlineColor(sf::Color::Black);
-        m_text.setFillColor(sf::Color::Black);
+        else m_overlay.setFont(m_font, 12, sf::Vector2f(646, 2), 62);
 
         // Set background fill colour
         setBackgroundColor(sf::Color::White);
 
+        // One texel per guest pixel, scaled up without filtering
+        m_screenTexture.create(64, 32);
+        m_screenTexture.setSmooth(false);
+        m_screenSprite.setTexture(m_screenTexture, true);
+        m_screenSprite.setScale(10, 10);
+
         // Set V-SYNC
         EnableVSync(true);
 
-        // Load rom
-        m_emulator.loadRom(m_romName);
+        if (!m_PlayMovieName.empty())
+        {
+            // A movie brings its own rom, seed and speed
+            if (m_Movie.Load(m_PlayMovieName) && m_Player.Start(m_emulator, m_Movie))
+                m_Movie.Configure(m_Scheduler);
+            else
+                std::cout << "Could not load movie " << m_PlayMovieName << "\n";
+        }
+        else
+        {
+            // Load rom
+            m_emulator.loadRom("roms/" + m_romName + ".ch8");
+
+            if (!m_RecordMovieName.empty())
+                m_Recorder.Start(m_emulator, (uint32_t)time(0), m_Scheduler);
+        }
+
+        // Settings and movies can both bring their own costs
+        chip8::Engine engine = m_emulator.getEngine();
+        if (!m_Scheduler.isUniform() && engine != chip8::Engine::Interpreter && engine != chip8::Engine::Decoded)
+            std::cout << "Cycle costs run one opcode at a time, the " << chip8::EngineName(engine) << " engine is as fast as Decoded\n";
+
+        // From here on only the emulation thread touches the emulator
+        m_EmulationRunning = true;
+        m_EmulationThread = std::thread(&App::EmulationLoop, this);
 
         return true;
     }
 
-    bool OnUserUpdate(sf::Time elapsed) override
+    bool HasChanged() override
     {
-        // Run emulator / opcodes
-        for (int i = 0; i < m_OpcodesPerFrame; i++)
-            m_emulator.Run();
+        FrameMetrics& metrics = getMetrics();
+
+        // Takes the newest emulated frame, older ones the display was too slow for are skipped
+        if (m_Frames.Update())
+        {
+            const EmulatedFrame& frame = m_Frames.getFront();
+
+            metrics.AddInstructions(frame.instructions - m_ShownInstructions);
+            metrics.AddTime(FrameMetrics::Emulation, frame.emulationTime - m_ShownEmulationTime);
+
+            m_ShownInstructions = frame.instructions;
+            m_ShownEmulationTime = frame.emulationTime;
+
+            // A guest waiting for input or its timer has nothing new for a while
+            setIdleWait(sf::milliseconds(frame.idle ? 16 : 4));
+
+            if (!m_screenUploaded || memcmp(frame.rows, m_shownRows, sizeof(m_shownRows)) != 0)
+                m_Changed = true;
+
+            FrameMetrics::Scope text(metrics, FrameMetrics::Text);
+            if (UpdateOverlay(frame))
+                m_Changed = true;
+        }
+
+        return m_Changed;
+    }
 
-        m_emulator.DecreaseTimers();
+    bool OnUserUpdate(sf::Time elapsed) override
+    {
+        FrameMetrics& metrics = getMetrics();
+        const EmulatedFrame& frame = m_Frames.getFront();
 
         // Display Pixels
-        for (int y = 0; y < 32; y++)
         {
-            for (int x = 0; x < 64; x++)
+            FrameMetrics::Scope drawing(metrics, FrameMetrics::Drawing);
+            DrawScreen(frame.rows);
+
+            if (m_overlayVisible)
+                Draw(m_overlay);
+        }
+
+        m_Changed = false;
+        return true;
+    }
+
+private:
+    void SendCommand(HostCommand::Type type, int key = 0)
+    {
+        // 256 commands in flight are never reached, a full queue drops the input
+        m_Commands.Push({ type, (uint8_t)key, EmulationClock::now() });
+
+        // Look for the frame the input leads to without delay
+        setIdleWait(sf::milliseconds(1));
+    }
+
+    /*
+        Emulation thread
+    */
+    void EmulationLoop()
+    {
+        const EmulationClock::duration frameTime = std::chrono::duration_cast<EmulationClock::duration>(std::chrono::duration<double>(1.0 / 60));
+
+        EmulationClock::time_point frameStart = EmulationClock::now();
+        uint64_t instructions = 0;
+        EmulationClock::duration busy = EmulationClock::duration::zero();
+
+        // Achieved speed, measured over half a second
+        EmulationClock::time_point speedStart = frameStart;
+        uint64_t speedFrames = 0;
+        float speed = 1.0f;
+
+        HostCommand command;
+        bool pending = false;
+        bool turbo = false;
+
+        while (m_EmulationRunning)
+        {
+            // Back from turbo the frames are paced from now on instead of catching up
+            if (turbo != m_Turbo)
+            {
+                turbo = m_Turbo;
+                frameStart = EmulationClock::now();
+            }
+
+            EmulationClock::duration period = frameTime;
+            if (m_Turbo)
+                period = m_TurboSpeed > 0 ? std::chrono::duration_cast<EmulationClock::duration>(frameTime / m_TurboSpeed) : EmulationClock::duration::zero();
+
+            uint32_t done = 0;
+            bool ranFrame = true;
+
+            m_Scheduler.BeginFrame();
+
+            // The frame runs in slices, each once its share of the frame time has passed
+            for (int slice = 0; slice < SLICES_PER_FRAME; slice++)
             {
-                if (m_emulator.getScreenData(x, y) == 1)
+                std::this_thread::sleep_until(frameStart + period * slice / SLICES_PER_FRAME);
+                EmulationClock::time_point sliceStart = EmulationClock::now();
+
+                // Parts of the frame's cycles
+                double end = (double)(slice + 1) / SLICES_PER_FRAME;
+                bool running = !m_Rewinding && !m_Player.isPlaying();
+                ranFrame = ranFrame && running;
+
+                // An input stamped at some point of the last slice lands at the same point of this one
+                for (;;)
                 {
-                    DrawPixel(x * 10, y * 10, 10);
+                    if (!pending && !(pending = m_Commands.Pop(command)))
+                        break;
+
+                    // Frames without a duration take all input at their start
+                    double due = 0.0;
+                    if (period > EmulationClock::duration::zero())
+                        due = std::chrono::duration<double>(command.time - frameStart) / period + 1.0 / SLICES_PER_FRAME;
+
+                    if (running && due >= end)
+                        break;
+
+                    if (running)
+                        done += m_Scheduler.Run(m_emulator, due);
+
+                    ApplyCommand(command, done);
+                    pending = false;
                 }
+
+                if (running)
+                    done += m_Scheduler.Run(m_emulator, end);
+
+                busy += EmulationClock::now() - sliceStart;
+            }
+
+            EmulationClock::time_point finishStart = EmulationClock::now();
+
+            // In turbo the frames the render thread has no time for are not even filled in
+            bool publish = !m_Turbo || m_Frames.isTaken();
+
+            instructions += done;
+            instructions += FinishFrame(ranFrame, publish);
+
+            EmulationClock::time_point now = EmulationClock::now();
+            busy += now - finishStart;
+
+            speedFrames++;
+            double window = std::chrono::duration<double>(now - speedStart).count();
+            if (window >= 0.5)
+            {
+                speed = (float)(speedFrames / (window * 60));
+                speedFrames = 0;
+                speedStart = now;
+            }
+
+            if (publish)
+            {
+                EmulatedFrame& output = m_Frames.getBack();
+                output.instructions = instructions;
+                output.emulationTime = busy;
+                output.turbo = m_Turbo;
+                output.speed = speed;
+                m_Frames.Publish();
             }
+
+            frameStart += period;
+
+            // After a stall, e.g. a suspended process, carry on from now instead of catching up in one burst
+            if (now - frameStart > frameTime * 15)
+                frameStart = now;
         }
+    }
 
-        DumpRegisters();
+    void ApplyCommand(const HostCommand& command, unsigned int instruction)
+    {
+        switch (command.type)
+        {
+            case HostCommand::KeyDown:
+            case HostCommand::KeyUp:
+            {
+                // A movie plays its own input
+                if (m_Player.isPlaying())
+                    break;
+
+                bool pressed = command.type == HostCommand::KeyDown;
+                if (pressed)
+                    m_emulator.KeyPressed(command.key);
+                else
+                    m_emulator.KeyReleased(command.key);
+
+                m_Recorder.Key(command.key, pressed, instruction);
+                break;
+            }
 
-        return true;
+            case HostCommand::RewindOn:
+                m_Rewinding = !MovieActive();
+                break;
+
+            case HostCommand::RewindOff:
+                m_Rewinding = false;
+                break;
+
+            case HostCommand::Save:
+                if (SaveState(m_romName + ".state", m_emulator, m_Scheduler.getClockRate()))
+                    std::cout << "Saved state\n";
+                break;
+
+            case HostCommand::Turbo:
+                m_Turbo = !m_Turbo;
+                break;
+
+            case HostCommand::Load:
+            {
+                uint32_t clockRate = 0;
+
+                if (MovieActive())
+                    std::cout << "Can not load a state while a movie records or plays\n";
+                else if (LoadState(m_romName + ".state", m_emulator, clockRate))
+                {
+                    if (clockRate > 0)
+                        m_Scheduler.setClockRate(clockRate);
+
+                    std::cout << "Loaded state\n";
+                }
+                break;
+            }
+        }
+    }
+
+    // Ends the frame and, if it is published, fills the back slot for the render thread.
+    // Returns the extra instructions run
+    uint64_t FinishFrame(bool ranFrame, bool publish)
+    {
+        chip8State state;
+        uint64_t instructions = 0;
+
+        // The cycles of a frame cut short are not carried into the next one
+        if (!ranFrame)
+            m_Scheduler.Reset();
+
+        if (m_Rewinding)
+        {
+            // Stays on the oldest frame once the history runs out
+            if (m_Rewind.Pop(state))
+                m_emulator.restore(state);
+        }
+        else
+        {
+            if (m_Player.isPlaying())
+            {
+                uint64_t before = m_Player.getInstructions();
+
+                if (!m_Player.RunFrame(m_emulator) && m_Player.hasDesynced())
+                    std::cout << "Movie desynced at frame " << m_Player.getFrame() << "\n";
+
+                instructions += m_Player.getInstructions() - before;
+            }
+            else if (ranFrame)
+            {
+                m_Scheduler.EndFrame(m_emulator);
+                m_Recorder.EndFrame(m_emulator);
+            }
+
+            m_emulator.snapshot(state);
+            m_Rewind.Push(state);
+        }
+
+        if (!publish)
+            return instructions;
+
+        EmulatedFrame& output = m_Frames.getBack();
+        m_emulator.snapshot(output.state);
+        memcpy(output.rows, output.state.screen, sizeof(output.rows));
+        output.idle = m_emulator.isIdle();
+
+        if (!m_Rewinding && m_RunAhead > 0)
+        {
+            // Show where the current input leads in K frames, then go back to the real frame
+            sf::Clock clock;
+
+            // On a copy, so the carried cycles stay those of the real frame
+            CycleScheduler ahead = m_Scheduler;
+
+#ifdef CHIP8_PROFILE
+            // The profile only counts the frames that really happen
+            m_emulator.getProfiler().setEnabled(false);
+#endif
+
+            for (unsigned int i = 0; i < m_RunAhead; i++)
+            {
+                ahead.BeginFrame();
+                instructions += ahead.Run(m_emulator);
+                ahead.EndFrame(m_emulator);
+            }
+
+            memcpy(output.rows, m_emulator.getScreenRows(), sizeof(output.rows));
+
+            m_emulator.restore(state);
+
+#ifdef CHIP8_PROFILE
+            m_emulator.getProfiler().setEnabled(true);
+#endif
+
+            m_HiddenFrames += m_RunAhead;
+            m_RunAheadMicroseconds += clock.getElapsedTime().asMicroseconds();
+
+            if (++m_RunAheadFrames == 60)
+            {
+                m_RunAheadCost = m_RunAheadMicroseconds / 1000.0f / m_RunAheadFrames;
+                m_RunAheadFrames = 0;
+                m_RunAheadMicroseconds = 0;
+            }
+        }
+
+        output.hiddenFrames = m_HiddenFrames;
+        output.runAheadCost = m_RunAheadCost;
+
+        return instructions;
     }
 };
 
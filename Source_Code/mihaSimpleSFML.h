@@ -45,6 +45,8 @@
 #include <string>
 #include <random>
 
+#include "framemetrics.h"
+
 // Random number generator in given range
 float fRandom(float first, float second)
 {
@@ -90,6 +92,9 @@ public:
 
         m_bVSync = false;
         m_bDone = false;
+        m_bRedraw = true;
+
+        m_idleWait = sf::milliseconds(4);
 
         m_backgroundColor = sf::Color::Black;
     }
@@ -102,6 +107,10 @@ public:
     //Can override this
     virtual void Event(sf::Event e) {}
 
+    // Return false while the last presented frame is still up to date, the loop
+    // then skips clearing, OnUserUpdate and the present and waits for events
+    virtual bool HasChanged() { return true; }
+
     int ScreenWidth() { return m_nScreenWidth; }
     int ScreenHeight() { return m_nScreenHeight; }
 
@@ -110,12 +119,18 @@ public:
 
     sf::RenderWindow* getWindow() { return &m_window; }
 
-    void Draw(sf::Drawable& l_drawable) { m_window.draw(l_drawable); }
-    void Draw(sf::Drawable& l_drawable, sf::Transform& l_transform) { m_window.draw(l_drawable, l_transform); }
-    void Draw(sf::VertexArray l_vertexArray) { m_window.draw(l_vertexArray); }
+    void Draw(sf::Drawable& l_drawable) { m_window.draw(l_drawable); m_metrics.AddDrawCalls(1); }
+    void Draw(sf::Drawable& l_drawable, sf::Transform& l_transform) { m_window.draw(l_drawable, l_transform); m_metrics.AddDrawCalls(1); }
+    void Draw(sf::VertexArray l_vertexArray) { m_window.draw(l_vertexArray); m_metrics.AddDrawCalls(1); }
+
+    // Per phase frame timings and counters, see FrameMetrics
+    FrameMetrics& getMetrics() { return m_metrics; }
 
     void setBackgroundColor(sf::Color l_color) { m_backgroundColor = l_color; }
 
+    // How long the loop waits for an event when nothing changed before asking HasChanged again
+    void setIdleWait(sf::Time l_wait) { m_idleWait = l_wait; }
+
 private:
     sf::RenderWindow m_window;
 
@@ -128,13 +143,46 @@ private:
 
     bool m_bVSync;
     bool m_bDone;
+    bool m_bRedraw;         // the window lost its contents, e.g. after a resize
+
+    sf::Time m_idleWait;
 
     sf::Clock m_clock;
     sf::Time m_elapsed;
 
+    FrameMetrics m_metrics;
+
     void BeginDraw(sf::Color l_color) { m_window.clear(l_color); }
     void EndDraw() { m_window.display(); }
 
+    void HandleEvent(sf::Event& event)
+    {
+        if (event.type == sf::Event::Closed)
+            m_bDone = true;
+
+        if (event.type == sf::Event::Resized || event.type == sf::Event::GainedFocus)
+            m_bRedraw = true;
+
+        Event(event);
+    }
+
+    // SFML 2 has no waitEvent with a timeout, and its waitEvent polls in a
+    // sleep loop itself, so this does the same in 2 ms steps
+    bool WaitEvent(sf::Event& event, sf::Time timeout)
+    {
+        sf::Clock clock;
+
+        while (!m_window.pollEvent(event))
+        {
+            if (clock.getElapsedTime() >= timeout)
+                return false;
+
+            sf::sleep(sf::milliseconds(2));
+        }
+
+        return true;
+    }
+
 public:
     void Construct(int l_nScreenWidth, int l_nScreenHeight, std::wstring l_title)
     {
@@ -154,22 +202,44 @@ public:
         //Main Game Loop
         while (!m_bDone)
         {
-            sf::Event event;
+            m_metrics.BeginFrame();
 
-            while (m_window.pollEvent(event))
             {
-                if (event.type == sf::Event::Closed)
-                    m_bDone = true;
+                FrameMetrics::Scope scope(m_metrics, FrameMetrics::Events);
+                sf::Event event;
 
-                Event(event);
+                while (m_window.pollEvent(event))
+                    HandleEvent(event);
             }
 
-            BeginDraw(m_backgroundColor);
+            // Nothing new to show, sleep until an event arrives or it is time to look again
+            if (!m_bDone && !m_bRedraw && !HasChanged())
+            {
+                sf::Event event;
+                if (WaitEvent(event, m_idleWait))
+                    HandleEvent(event);
+
+                m_metrics.SkipFrame();
+                continue;
+            }
 
+            m_bRedraw = false;
+
+            {
+                FrameMetrics::Scope scope(m_metrics, FrameMetrics::Drawing);
+                BeginDraw(m_backgroundColor);
+            }
+
+            // OnUserUpdate times its own phases
             if (!OnUserUpdate(m_elapsed))
                 m_bDone = true;
 
-            EndDraw();
+            {
+                FrameMetrics::Scope scope(m_metrics, FrameMetrics::Present);
+                EndDraw();
+            }
+
+            m_metrics.EndFrame();
 
             m_elapsed = m_clock.restart();
         }
@@ -0,0 +1,321 @@
+#include "movie.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char MOVIE_MAGIC[4] = { 'C', '8', 'M', 'V' };
+
+static void WriteVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        out.push_back((uint8_t)(value | 0x80));
+    out.push_back((uint8_t)value);
+}
+
+static bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7)
+    {
+        uint8_t byte = *data++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+static uint64_t StateHash(chip8& emulator)
+{
+    chip8State state;
+    emulator.snapshot(state);
+    return chip8::Hash(&state, sizeof(state));
+}
+
+bool Movie::Save(const std::string& fileName) const
+{
+    MovieHeader header = {};
+    memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.headerSize = sizeof(MovieHeader);
+    header.romHash = chip8::Hash(rom.data(), rom.size());
+    header.romSize = (uint32_t)rom.size();
+    header.seed = seed;
+    header.clockRate = clockRate;
+    header.hashInterval = hashInterval;
+    header.frames = frames;
+    header.eventCount = (uint32_t)events.size();
+    header.hashCount = (uint32_t)hashes.size();
+    header.costCount = (uint32_t)cycleCosts.size();
+
+    // Events are typically 3 bytes
+    std::vector<uint8_t> encoded;
+    encoded.reserve(events.size() * 3);
+
+    uint32_t frame = 0;
+    for (const MovieEvent& event : events)
+    {
+        WriteVarint(encoded, event.frame - frame);
+        WriteVarint(encoded, event.instruction);
+        encoded.push_back((uint8_t)(event.key | (event.pressed ? 0x80 : 0)));
+        frame = event.frame;
+    }
+
+    FILE* out = fopen(fileName.c_str(), "wb");
+    if (!out)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(rom.data(), 1, rom.size(), out) == rom.size() &&
+              fwrite(cycleCosts.data(), sizeof(uint32_t), cycleCosts.size(), out) == cycleCosts.size() &&
+              fwrite(encoded.data(), 1, encoded.size(), out) == encoded.size() &&
+              fwrite(hashes.data(), sizeof(uint64_t), hashes.size(), out) == hashes.size();
+
+    return fclose(out) == 0 && ok;
+}
+
+bool Movie::Load(const std::string& fileName)
+{
+    FILE* in = fopen(fileName.c_str(), "rb");
+    if (!in)
+        return false;
+
+    std::vector<uint8_t> file;
+    uint8_t buffer[0x10000];
+    for (size_t size; (size = fread(buffer, 1, sizeof(buffer), in)) > 0;)
+        file.insert(file.end(), buffer, buffer + size);
+    fclose(in);
+
+    MovieHeader header;
+    if (file.size() < sizeof(header))
+        return false;
+
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) != 0 || header.version == 0 || header.version > VERSION ||
+        header.headerSize < sizeof(header) || header.headerSize > file.size())
+        return false;
+
+    const uint8_t* data = file.data() + header.headerSize;
+    const uint8_t* end = file.data() + file.size();
+
+    if (header.romSize > (size_t)(end - data) || header.clockRate == 0 || header.hashInterval == 0)
+        return false;
+
+    Movie movie;
+    movie.rom.assign(data, data + header.romSize);
+    movie.seed = header.seed;
+    movie.hashInterval = header.hashInterval;
+    movie.frames = header.frames;
+    data += header.romSize;
+
+    if (chip8::Hash(movie.rom.data(), movie.rom.size()) != header.romHash)
+        return false;
+
+    if (header.version == 1)
+    {
+        // Fixed opcodes per frame, all of them one cycle
+        if (header.clockRate > UINT32_MAX / CycleScheduler::TIMER_RATE || header.costCount != 0)
+            return false;
+
+        movie.clockRate = header.clockRate * CycleScheduler::TIMER_RATE;
+        movie.cycleCosts.assign((size_t)Op::Count, 1);
+    }
+    else
+    {
+        if (header.costCount != (uint32_t)Op::Count || (size_t)(end - data) < header.costCount * sizeof(uint32_t))
+            return false;
+
+        movie.clockRate = header.clockRate;
+        movie.cycleCosts.resize(header.costCount);
+        memcpy(movie.cycleCosts.data(), data, header.costCount * sizeof(uint32_t));
+        data += header.costCount * sizeof(uint32_t);
+    }
+
+    movie.events.reserve(header.eventCount);
+
+    uint32_t frame = 0;
+    for (uint32_t i = 0; i < header.eventCount; i++)
+    {
+        uint32_t delta, instruction;
+        if (!ReadVarint(data, end, delta) || !ReadVarint(data, end, instruction) || data == end)
+            return false;
+
+        uint8_t key = *data++;
+        frame += delta;
+
+        // Every opcode costs at least a cycle, so no frame runs more than the clock rate
+        if (instruction > movie.clockRate || frame >= movie.frames)
+            return false;
+
+        movie.events.push_back({ frame, instruction, (uint8_t)(key & 0xF), (uint8_t)(key >> 7) });
+    }
+
+    if ((size_t)(end - data) < (size_t)header.hashCount * sizeof(uint64_t))
+        return false;
+
+    movie.hashes.resize(header.hashCount);
+    memcpy(movie.hashes.data(), data, movie.hashes.size() * sizeof(uint64_t));
+
+    *this = std::move(movie);
+    return true;
+}
+
+void Movie::Configure(CycleScheduler& scheduler) const
+{
+    scheduler.setClockRate(clockRate);
+
+    for (size_t i = 0; i < cycleCosts.size() && i < (size_t)Op::Count; i++)
+        scheduler.setCost((Op)i, cycleCosts[i]);
+}
+
+MovieRecorder::MovieRecorder()
+{
+    m_Recording = false;
+}
+
+void MovieRecorder::Start(chip8& emulator, uint32_t seed, CycleScheduler& scheduler, uint32_t hashInterval)
+{
+    emulator.setSeed(seed);
+
+    chip8State state;
+    emulator.snapshot(state);
+
+    m_Movie = Movie();
+    m_Movie.rom.assign(&state.memory[0x200], &state.memory[0x200] + emulator.getRomSize());
+    m_Movie.seed = seed;
+    m_Movie.clockRate = scheduler.getClockRate();
+    m_Movie.hashInterval = hashInterval > 0 ? hashInterval : 1;
+
+    m_Movie.cycleCosts.resize((size_t)Op::Count);
+    for (size_t i = 0; i < m_Movie.cycleCosts.size(); i++)
+        m_Movie.cycleCosts[i] = scheduler.getCost((Op)i);
+
+    m_Recording = true;
+}
+
+bool MovieRecorder::isRecording()
+{
+    return m_Recording;
+}
+
+void MovieRecorder::Key(int key, bool pressed, uint32_t instruction)
+{
+    if (!m_Recording || key < 0 || key > 0xF)
+        return;
+
+    m_Movie.events.push_back({ m_Movie.frames, instruction, (uint8_t)key, (uint8_t)pressed });
+}
+
+void MovieRecorder::EndFrame(chip8& emulator)
+{
+    if (!m_Recording)
+        return;
+
+    if (++m_Movie.frames % m_Movie.hashInterval == 0)
+        m_Movie.hashes.push_back(StateHash(emulator));
+}
+
+bool MovieRecorder::Stop(const std::string& fileName)
+{
+    if (!m_Recording)
+        return false;
+
+    m_Recording = false;
+    return m_Movie.Save(fileName);
+}
+
+const Movie& MovieRecorder::getMovie()
+{
+    return m_Movie;
+}
+
+MoviePlayer::MoviePlayer()
+{
+    m_Movie = nullptr;
+    m_Frame = 0;
+    m_NextEvent = 0;
+    m_Desynced = false;
+}
+
+bool MoviePlayer::Start(chip8& emulator, const Movie& movie)
+{
+    m_Movie = nullptr;
+
+    if (!emulator.loadRom(movie.rom.data(), movie.rom.size()))
+        return false;
+
+    emulator.setSeed(movie.seed);
+
+    m_Scheduler = CycleScheduler();
+    movie.Configure(m_Scheduler);
+
+    m_Movie = &movie;
+    m_Frame = 0;
+    m_NextEvent = 0;
+    m_Desynced = false;
+    return true;
+}
+
+bool MoviePlayer::RunFrame(chip8& emulator)
+{
+    if (!isPlaying())
+        return false;
+
+    const Movie& movie = *m_Movie;
+
+    m_Scheduler.BeginFrame();
+
+    // Run up to each event of the frame, then apply it
+    uint32_t done = 0;
+    for (; m_NextEvent < movie.events.size() && movie.events[m_NextEvent].frame == m_Frame; m_NextEvent++)
+    {
+        const MovieEvent& event = movie.events[m_NextEvent];
+
+        if (event.instruction > done)
+            done += m_Scheduler.Run(emulator, 1.0, event.instruction - done);
+
+        if (event.pressed)
+            emulator.KeyPressed(event.key);
+        else
+            emulator.KeyReleased(event.key);
+    }
+
+    m_Scheduler.Run(emulator);
+    m_Scheduler.EndFrame(emulator);
+    m_Frame++;
+
+    if (m_Frame % movie.hashInterval == 0)
+    {
+        size_t index = m_Frame / movie.hashInterval - 1;
+        if (index < movie.hashes.size() && movie.hashes[index] != StateHash(emulator))
+        {
+            m_Desynced = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MoviePlayer::isPlaying()
+{
+    return m_Movie && !m_Desynced && m_Frame < m_Movie->frames;
+}
+
+bool MoviePlayer::hasDesynced()
+{
+    return m_Desynced;
+}
+
+uint32_t MoviePlayer::getFrame()
+{
+    return m_Frame;
+}
+
+uint64_t MoviePlayer::getInstructions()
+{
+    return m_Scheduler.getInstructions();
+}
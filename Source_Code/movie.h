@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "scheduler.h"
+
+/*
+// Input movies
+//
+// A movie is everything needed to reproduce a run from power-on: the rom,
+// the CXNN seed, the clock rate and cycle costs of the CycleScheduler and
+// every key change keyed by frame and by the number of opcodes of that frame
+// that ran before it. Every
+// hashInterval frames the hash of the whole chip8State is stored as well,
+// so a replay that takes a different path is caught within that many frames
+// instead of at the end.
+//
+// Replays run as fast as the host allows, any engine gives the same hashes.
+//
+// File format, host byte order:
+//     MovieHeader
+//     uint8_t  rom[romSize]
+//     uint32_t cycleCosts[costCount]      one per Op
+//   then one event each:
+//     varint   frame           frames since the previous event
+//     varint   instruction
+//     uint8_t  key | pressed << 7
+//   then:
+//     uint64_t hashes[hashCount]
+//
+// Version 1 movies ran a fixed number of opcodes per frame, they load as a
+// clock rate of 60 times that with every opcode costing one cycle.
+*/
+
+struct MovieHeader
+{
+    char     magic[4];          // "C8MV"
+    uint16_t version;
+    uint16_t headerSize;
+
+    uint64_t romHash;
+    uint32_t romSize;
+    uint32_t seed;
+    uint32_t clockRate;         // opcodes per frame in version 1
+    uint32_t hashInterval;
+
+    uint32_t frames;
+    uint32_t eventCount;
+    uint32_t hashCount;
+    uint32_t costCount;         // 0 in version 1
+};
+
+static_assert(sizeof(MovieHeader) == 48, "MovieHeader is written as is");
+
+struct MovieEvent
+{
+    uint32_t frame;
+    uint32_t instruction;       // opcodes of the frame that ran before the key changed
+    uint8_t  key;
+    uint8_t  pressed;
+};
+
+struct Movie
+{
+    static const uint16_t VERSION = 2;
+
+    std::vector<uint8_t> rom;
+    uint32_t seed = 1;
+    uint32_t clockRate = 800;
+    std::vector<uint32_t> cycleCosts;   // one per Op
+    uint32_t hashInterval = 60;
+    uint32_t frames = 0;
+
+    std::vector<MovieEvent> events;     // sorted by frame and instruction
+    std::vector<uint64_t> hashes;       // after frame (i + 1) * hashInterval
+
+    bool Save(const std::string& fileName) const;
+
+    // Fails on damaged files and files from a newer version
+    bool Load(const std::string& fileName);
+
+    // Sets the clock rate and cycle costs the movie was recorded with
+    void Configure(CycleScheduler& scheduler) const;
+};
+
+class MovieRecorder
+{
+public:
+    MovieRecorder();
+
+    // Call right after the rom was loaded into a freshly constructed emulator,
+    // the seed is applied to it. Frames have to be run by a scheduler set up
+    // the same way as this one
+    void Start(chip8& emulator, uint32_t seed, CycleScheduler& scheduler, uint32_t hashInterval = 60);
+
+    bool isRecording();
+
+    // Forward every change of a guest key, also when the key goes to the emulator.
+    // instruction is the number of opcodes the scheduler ran in this frame so far
+    void Key(int key, bool pressed, uint32_t instruction = 0);
+
+    // After the timers of a frame were decreased
+    void EndFrame(chip8& emulator);
+
+    // Stops recording and writes the movie
+    bool Stop(const std::string& fileName);
+
+    const Movie& getMovie();
+
+private:
+    Movie m_Movie;
+    bool m_Recording;
+};
+
+class MoviePlayer
+{
+public:
+    MoviePlayer();
+
+    // Loads the movie's rom and seed into a freshly constructed emulator
+    bool Start(chip8& emulator, const Movie& movie);
+
+    // Runs the next frame with its input and checks the hash when one is due.
+    // Returns false once the movie is over or the run desynced
+    bool RunFrame(chip8& emulator);
+
+    bool isPlaying();
+    bool hasDesynced();
+
+    // Frames run so far, the frame a desync was noticed at
+    uint32_t getFrame();
+
+    // Opcodes run so far
+    uint64_t getInstructions();
+
+private:
+    const Movie* m_Movie;
+    CycleScheduler m_Scheduler;
+    uint32_t m_Frame;
+    size_t m_NextEvent;
+    bool m_Desynced;
+};
@@ -0,0 +1,223 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+GuestProfiler::GuestProfiler()
+{
+    m_Enabled = true;
+    Reset();
+}
+
+void GuestProfiler::Reset()
+{
+    m_OpCounts.fill(0);
+    m_PcCounts.fill(0);
+    m_CallCounts.fill(0);
+
+    m_Nodes.clear();
+    m_Children.clear();
+
+    // Node 0 is the code outside of any subroutine
+    m_Nodes.push_back({ 0, 0, 0 });
+    m_Current = 0;
+    m_Depth = 0;
+}
+
+void GuestProfiler::setEnabled(bool enabled)
+{
+    m_Enabled = enabled;
+}
+
+bool GuestProfiler::isEnabled()
+{
+    return m_Enabled;
+}
+
+void GuestProfiler::Resync(const uint16_t* stack, uint8_t stackPointer, const uint8_t* memory)
+{
+    m_Current = 0;
+    m_Depth = 0;
+
+    for (int i = 0; i < stackPointer && i < 16; i++)
+    {
+        uint16_t call = stack[i] - 2;
+        uint16_t opcode = (memory[call & 0xFFF] << 8) | memory[(call + 1) & 0xFFF];
+
+        // Return addresses that do not follow a call get a frame of their own
+        Enter((opcode & 0xF000) == 0x2000 ? opcode & 0x0FFF : call & 0xFFF);
+    }
+}
+
+uint64_t GuestProfiler::getInstructions()
+{
+    uint64_t total = 0;
+    for (uint64_t count : m_OpCounts)
+        total += count;
+
+    return total;
+}
+
+uint64_t GuestProfiler::getOpCount(Op op)
+{
+    return m_OpCounts[(size_t)op];
+}
+
+uint64_t GuestProfiler::getPcCount(uint16_t pc)
+{
+    return m_PcCounts[pc & 0xFFF];
+}
+
+bool GuestProfiler::WriteHistogram(const std::string& fileName)
+{
+    FILE* out = fopen(fileName.c_str(), "w");
+    if (!out)
+        return false;
+
+    uint64_t total = getInstructions();
+    double percent = total > 0 ? 100.0 / total : 0.0;
+
+    fprintf(out, "instructions %llu\n", (unsigned long long)total);
+
+    // Opcode classes, most executed first
+    std::vector<size_t> ops;
+    for (size_t op = 0; op < m_OpCounts.size(); op++)
+    {
+        if (m_OpCounts[op] > 0)
+            ops.push_back(op);
+    }
+    std::sort(ops.begin(), ops.end(), [&](size_t a, size_t b) { return m_OpCounts[a] > m_OpCounts[b]; });
+
+    fprintf(out, "\n# opcode      count       %%\n");
+    for (size_t op : ops)
+        fprintf(out, "%-8s %12llu %7.2f\n", OpName((Op)op), (unsigned long long)m_OpCounts[op], m_OpCounts[op] * percent);
+
+    // Hottest guest addresses
+    std::vector<uint16_t> pcs;
+    for (uint16_t pc = 0; pc < 0x1000; pc++)
+    {
+        if (m_PcCounts[pc] > 0)
+            pcs.push_back(pc);
+    }
+    std::sort(pcs.begin(), pcs.end(), [&](uint16_t a, uint16_t b) { return m_PcCounts[a] > m_PcCounts[b]; });
+
+    if (pcs.size() > 64)
+        pcs.resize(64);
+
+    fprintf(out, "\n# pc          count       %%\n");
+    for (uint16_t pc : pcs)
+        fprintf(out, "0x%03X    %12llu %7.2f\n", pc, (unsigned long long)m_PcCounts[pc], m_PcCounts[pc] * percent);
+
+    // Subroutines: self counts only their own instructions, inclusive also
+    // everything they called. Recursion is counted once per stack
+    std::vector<uint64_t> self(0x1000, 0), inclusive(0x1000, 0);
+    std::vector<uint16_t> seen;
+
+    for (uint32_t i = 1; i < m_Nodes.size(); i++)
+    {
+        if (m_Nodes[i].self == 0)
+            continue;
+
+        self[m_Nodes[i].address] += m_Nodes[i].self;
+
+        seen.clear();
+        for (uint32_t node = i; node != 0; node = m_Nodes[node].parent)
+        {
+            uint16_t address = m_Nodes[node].address;
+            if (std::find(seen.begin(), seen.end(), address) == seen.end())
+            {
+                inclusive[address] += m_Nodes[i].self;
+                seen.push_back(address);
+            }
+        }
+    }
+
+    std::vector<uint16_t> subroutines;
+    for (uint16_t address = 0; address < 0x1000; address++)
+    {
+        if (m_CallCounts[address] > 0 || inclusive[address] > 0)
+            subroutines.push_back(address);
+    }
+    std::sort(subroutines.begin(), subroutines.end(), [&](uint16_t a, uint16_t b) { return inclusive[a] > inclusive[b]; });
+
+    fprintf(out, "\n# subroutine  calls     inclusive       %%         self       %%\n");
+    for (uint16_t address : subroutines)
+    {
+        fprintf(out, "0x%03X    %10llu %13llu %7.2f %12llu %7.2f\n", address,
+                (unsigned long long)m_CallCounts[address],
+                (unsigned long long)inclusive[address], inclusive[address] * percent,
+                (unsigned long long)self[address], self[address] * percent);
+    }
+
+    fclose(out);
+    return true;
+}
+
+bool GuestProfiler::WriteFoldedStacks(const std::string& fileName)
+{
+    FILE* out = fopen(fileName.c_str(), "w");
+    if (!out)
+        return false;
+
+    for (uint32_t i = 0; i < m_Nodes.size(); i++)
+    {
+        if (m_Nodes[i].self > 0)
+            fprintf(out, "%s %llu\n", StackName(i).c_str(), (unsigned long long)m_Nodes[i].self);
+    }
+
+    fclose(out);
+    return true;
+}
+
+/*
+    PRIVATE Functions
+*/
+void GuestProfiler::Call(uint16_t address)
+{
+    m_CallCounts[address & 0xFFF]++;
+    Enter(address);
+}
+
+void GuestProfiler::Enter(uint16_t address)
+{
+    if (++m_Depth > MAX_DEPTH)
+        return;
+
+    uint64_t key = ((uint64_t)m_Current << 16) | (address & 0xFFF);
+
+    auto child = m_Children.find(key);
+    if (child == m_Children.end())
+    {
+        m_Nodes.push_back({ m_Current, (uint16_t)(address & 0xFFF), 0 });
+        child = m_Children.emplace(key, (uint32_t)(m_Nodes.size() - 1)).first;
+    }
+
+    m_Current = child->second;
+}
+
+void GuestProfiler::Return()
+{
+    // A return without a matching call stays at the top level
+    if (m_Depth == 0)
+        return;
+
+    if (m_Depth-- <= MAX_DEPTH)
+        m_Current = m_Nodes[m_Current].parent;
+}
+
+std::string GuestProfiler::StackName(uint32_t node)
+{
+    std::vector<uint32_t> chain;
+    for (; node != 0; node = m_Nodes[node].parent)
+        chain.push_back(node);
+
+    std::string name = "main";
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+    {
+        char frame[16];
+        snprintf(frame, sizeof(frame), ";sub_%03X", m_Nodes[*it].address);
+        name += frame;
+    }
+
+    return name;
+}
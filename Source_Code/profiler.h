@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "decoder.h"
+
+/*
+// Guest profiler
+//
+// Counts executed instructions per opcode class and per guest PC, and
+// follows 2NNN / 00EE with a shadow call stack so every instruction is
+// charged to the chain of subroutines it ran in. Exports a text histogram
+// and folded stacks ("main;sub_2A4;sub_310 1234") for flamegraph.pl,
+// speedscope and similar tools.
+//
+// Only compiled into chip8 when CHIP8_PROFILE is defined, see the CMake
+// option of the same name. Without it the hooks in chip8.cpp are empty.
+*/
+
+class GuestProfiler
+{
+public:
+    GuestProfiler();
+
+    void Reset();
+
+    // While disabled nothing is counted, e.g. for frames that are run
+    // speculatively and thrown away again
+    void setEnabled(bool enabled);
+    bool isEnabled();
+
+    // Called before every instruction executes, pc is its address
+    void Count(uint16_t pc, const Instruction& in)
+    {
+        if (!m_Enabled)
+            return;
+
+        m_OpCounts[(size_t)in.op]++;
+        m_PcCounts[pc & 0xFFF]++;
+        m_Nodes[m_Current].self++;
+
+        if (in.op == Op::Op2NNN)
+            Call(in.nnn);
+        else if (in.op == Op::Op00EE)
+            Return();
+    }
+
+    // Rebuilds the shadow stack from the guest stack, e.g. after a restore.
+    // The call target is read from the 2NNN in front of each return address,
+    // the frames it enters are not counted as calls
+    void Resync(const uint16_t* stack, uint8_t stackPointer, const uint8_t* memory);
+
+    uint64_t getInstructions();
+    uint64_t getOpCount(Op op);
+    uint64_t getPcCount(uint16_t pc);
+
+    bool WriteHistogram(const std::string& fileName);
+    bool WriteFoldedStacks(const std::string& fileName);
+
+private:
+    // Deeper calls are charged to the deepest tracked subroutine, this keeps
+    // ROMs that use 2NNN as a jump from growing the tree without bound
+    static const uint32_t MAX_DEPTH = 64;
+
+    struct Node
+    {
+        uint32_t parent;
+        uint16_t address;   // subroutine entry, 0 for the root
+        uint64_t self;      // instructions executed with this exact stack
+    };
+
+    std::array<uint64_t, (size_t)Op::Count> m_OpCounts;
+    std::array<uint64_t, 0x1000> m_PcCounts;
+    std::array<uint64_t, 0x1000> m_CallCounts;
+
+    std::vector<Node> m_Nodes;
+    std::unordered_map<uint64_t, uint32_t> m_Children;  // parent << 16 | address -> node
+
+    uint32_t m_Current;
+    uint32_t m_Depth;       // may exceed the tracked depth, so returns still match
+
+    bool     m_Enabled;
+
+private:
+    void Call(uint16_t address);
+    void Return();
+
+    // Moves the shadow stack into a subroutine without counting a call
+    void Enter(uint16_t address);
+
+    std::string StackName(uint32_t node);
+};
@@ -0,0 +1,201 @@
+#include "rewind.h"
+
+#include <cstring>
+
+static_assert(sizeof(chip8State) % sizeof(uint64_t) == 0, "chip8State is encoded in whole 64-bit words");
+
+/*
+    Delta format, repeated until the changed words are exhausted:
+        uint16_t  unchanged words to skip
+        uint16_t  changed words that follow
+        uint64_t  XOR of each changed word
+*/
+
+RewindBuffer::RewindBuffer(size_t arenaBytes, uint32_t maxFrames)
+{
+    m_Arena.resize(arenaBytes);
+    m_Scratch.resize(STATE_WORDS * (sizeof(uint64_t) + 2 * sizeof(uint16_t)) + 2 * sizeof(uint16_t));
+    m_Entries.resize(maxFrames > 0 ? maxFrames : 1);
+
+    Clear();
+}
+
+void RewindBuffer::Clear()
+{
+    m_First = 0;
+    m_Count = 0;
+    m_Head = 0;
+    m_BytesUsed = 0;
+    m_HasCurrent = false;
+}
+
+void RewindBuffer::Push(const chip8State& state)
+{
+    if (!m_HasCurrent)
+    {
+        m_Current = state;
+        m_HasCurrent = true;
+        return;
+    }
+
+    size_t size = Encode(m_Current, state);
+    m_Current = state;
+
+    if (size > m_Arena.size())
+    {
+        // Does not fit at all, the history before this frame is lost
+        m_First = m_Count = 0;
+        m_Head = m_BytesUsed = 0;
+        return;
+    }
+
+    if (m_Count == m_Entries.size())
+        DropOldest();
+
+    if (m_Head + size > m_Arena.size())
+    {
+        // Anything between the head and the end of the arena is older than
+        // what wraps around to the start, so it goes first
+        while (m_Count > 0 && m_Entries[m_First].offset >= m_Head)
+            DropOldest();
+
+        m_Head = 0;
+    }
+
+    // Oldest deltas sit right after the head, drop them until the new one fits
+    while (m_Count > 0)
+    {
+        const Entry& oldest = m_Entries[m_First];
+        if (oldest.offset >= m_Head + size || oldest.offset + oldest.size <= m_Head)
+            break;
+
+        DropOldest();
+    }
+
+    if (m_Count == 0)
+        m_Head = 0;
+
+    memcpy(&m_Arena[m_Head], m_Scratch.data(), size);
+
+    Entry& entry = m_Entries[(m_First + m_Count) % m_Entries.size()];
+    entry.offset = (uint32_t)m_Head;
+    entry.size = (uint32_t)size;
+
+    m_Count++;
+    m_Head += size;
+    m_BytesUsed += size;
+}
+
+bool RewindBuffer::Pop(chip8State& state)
+{
+    if (!m_HasCurrent)
+        return false;
+
+    if (m_Count == 0)
+    {
+        state = m_Current;
+        return false;
+    }
+
+    const Entry& newest = m_Entries[(m_First + m_Count - 1) % m_Entries.size()];
+    Decode(&m_Arena[newest.offset], newest.size, m_Current);
+
+    // The newest delta always ends at the head
+    m_Head = newest.offset;
+    m_BytesUsed -= newest.size;
+    m_Count--;
+
+    state = m_Current;
+    return true;
+}
+
+uint32_t RewindBuffer::getFrames()
+{
+    return m_Count;
+}
+
+size_t RewindBuffer::getBytesUsed()
+{
+    return m_BytesUsed;
+}
+
+size_t RewindBuffer::Encode(const chip8State& older, const chip8State& newer)
+{
+    uint64_t a[STATE_WORDS], b[STATE_WORDS];
+    memcpy(a, &older, sizeof(a));
+    memcpy(b, &newer, sizeof(b));
+
+    uint8_t* out = m_Scratch.data();
+    size_t size = 0;
+
+    size_t word = 0;
+    while (word < STATE_WORDS)
+    {
+        size_t skip = word;
+        while (word < STATE_WORDS && a[word] == b[word])
+            word++;
+
+        // Trailing unchanged words need no token
+        if (word == STATE_WORDS)
+            break;
+
+        size_t start = word;
+        while (word < STATE_WORDS && a[word] != b[word])
+            word++;
+
+        uint16_t token[2] = { (uint16_t)(start - skip), (uint16_t)(word - start) };
+        memcpy(out + size, token, sizeof(token));
+        size += sizeof(token);
+
+        for (size_t i = start; i < word; i++)
+        {
+            uint64_t diff = a[i] ^ b[i];
+            memcpy(out + size, &diff, sizeof(diff));
+            size += sizeof(diff);
+        }
+    }
+
+    // Identical frames still take an empty token, every delta occupies arena space
+    if (size == 0)
+    {
+        uint16_t token[2] = { 0, 0 };
+        memcpy(out, token, sizeof(token));
+        size = sizeof(token);
+    }
+
+    return size;
+}
+
+void RewindBuffer::Decode(const uint8_t* data, size_t size, chip8State& state)
+{
+    uint64_t words[STATE_WORDS];
+    memcpy(words, &state, sizeof(words));
+
+    size_t word = 0;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        uint16_t token[2];
+        memcpy(token, data + pos, sizeof(token));
+        pos += sizeof(token);
+
+        word += token[0];
+        for (uint16_t i = 0; i < token[1]; i++, word++)
+        {
+            uint64_t diff;
+            memcpy(&diff, data + pos, sizeof(diff));
+            pos += sizeof(diff);
+
+            words[word] ^= diff;
+        }
+    }
+
+    memcpy(&state, words, sizeof(words));
+}
+
+void RewindBuffer::DropOldest()
+{
+    m_BytesUsed -= m_Entries[m_First].size;
+    m_First = (m_First + 1) % m_Entries.size();
+    m_Count--;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.h"
+
+/*
+// Rewind history
+//
+// Keeps the newest state in full and every older frame as the XOR against
+// the frame after it, run length encoded in 64-bit words. Between two frames
+// only a few registers, some memory and a couple of screen rows change, so a
+// frame typically costs well under 100 bytes.
+//
+// Deltas live in a fixed size circular arena, the oldest frames are dropped
+// when it or the frame limit is full. Nothing is allocated after construction.
+*/
+
+class RewindBuffer
+{
+public:
+    RewindBuffer(size_t arenaBytes, uint32_t maxFrames);
+
+    // Forgets the history
+    void Clear();
+
+    // Records the state after a frame
+    void Push(const chip8State& state);
+
+    // Steps one frame back, returns false if there is no older frame
+    bool Pop(chip8State& state);
+
+    uint32_t getFrames();
+    size_t getBytesUsed();
+
+private:
+    static const size_t STATE_WORDS = sizeof(chip8State) / sizeof(uint64_t);
+
+    struct Entry
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    std::vector<uint8_t> m_Arena;
+    std::vector<uint8_t> m_Scratch;     // one encoded delta, worst case size
+    std::vector<Entry>   m_Entries;     // ring, oldest at m_First
+
+    uint32_t m_First;
+    uint32_t m_Count;
+    size_t   m_Head;                    // arena offset for the next delta
+    size_t   m_BytesUsed;
+
+    chip8State m_Current;
+    bool       m_HasCurrent;
+
+private:
+    size_t Encode(const chip8State& older, const chip8State& newer);
+    void Decode(const uint8_t* data, size_t size, chip8State& state);
+
+    void DropOldest();
+};
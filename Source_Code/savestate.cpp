@@ -0,0 +1,204 @@
+#include "savestate.h"
+#include "scheduler.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+static const char SAVESTATE_MAGIC[4] = { 'C', '8', 'S', 'S' };
+
+// Read only view of a whole file
+class MappedFile
+{
+public:
+    MappedFile(const std::string& fileName)
+    {
+        m_Data = nullptr;
+        m_Size = 0;
+
+#ifdef _WIN32
+        m_File = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        m_Mapping = nullptr;
+
+        if (m_File == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+            return;
+
+        m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_Mapping)
+            return;
+
+        m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_Data)
+            m_Size = (size_t)size.QuadPart;
+#else
+        int file = open(fileName.c_str(), O_RDONLY);
+        if (file < 0)
+            return;
+
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED)
+            {
+                m_Data = static_cast<const uint8_t*>(data);
+                m_Size = (size_t)info.st_size;
+            }
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        close(file);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+        if (m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+#else
+        if (m_Data)
+            munmap(const_cast<uint8_t*>(m_Data), m_Size);
+#endif
+    }
+
+    const uint8_t* Data() { return m_Data; }
+    size_t Size() { return m_Size; }
+
+private:
+    const uint8_t* m_Data;
+    size_t         m_Size;
+
+#ifdef _WIN32
+    HANDLE m_File;
+    HANDLE m_Mapping;
+#endif
+};
+
+bool SaveState(const std::string& fileName, chip8& cpu, uint32_t clockRate)
+{
+    // Header and state go out in a single write
+    struct
+    {
+        SaveStateHeader header;
+        chip8State      state;
+    } file;
+
+    memset(&file.header, 0, sizeof(file.header));
+    cpu.snapshot(file.state);
+
+    memcpy(file.header.magic, SAVESTATE_MAGIC, sizeof(SAVESTATE_MAGIC));
+    file.header.version = SAVESTATE_VERSION;
+    file.header.headerSize = sizeof(SaveStateHeader);
+    file.header.stateSize = sizeof(chip8State);
+    file.header.romHash = cpu.getRomHash();
+    file.header.romSize = cpu.getRomSize();
+    file.header.engine = (uint32_t)cpu.getEngine();
+    file.header.clockRate = clockRate;
+    file.header.checksum = chip8::Hash(&file.state, sizeof(file.state));
+
+    static_assert(sizeof(file) == sizeof(SaveStateHeader) + sizeof(chip8State), "save state layout must not contain padding");
+
+    FILE* out = fopen(fileName.c_str(), "wb");
+    if (!out)
+    {
+        printf("Could not write save state %s\n", fileName.c_str());
+        return false;
+    }
+
+    bool written = fwrite(&file, sizeof(file), 1, out) == 1;
+    written = fclose(out) == 0 && written;
+
+    if (!written)
+        printf("Could not write save state %s\n", fileName.c_str());
+
+    return written;
+}
+
+bool LoadState(const std::string& fileName, chip8& cpu, uint32_t& clockRate)
+{
+    MappedFile file(fileName);
+    if (!file.Data())
+    {
+        printf("Could not open save state %s\n", fileName.c_str());
+        return false;
+    }
+
+    if (file.Size() < sizeof(SaveStateHeader))
+    {
+        printf("Save state %s is damaged\n", fileName.c_str());
+        return false;
+    }
+
+    const SaveStateHeader* header = reinterpret_cast<const SaveStateHeader*>(file.Data());
+
+    if (memcmp(header->magic, SAVESTATE_MAGIC, sizeof(SAVESTATE_MAGIC)) != 0)
+    {
+        printf("%s is not a save state\n", fileName.c_str());
+        return false;
+    }
+
+    if (header->version == 0 || header->version > SAVESTATE_VERSION || header->headerSize != sizeof(SaveStateHeader) || header->stateSize != sizeof(chip8State))
+    {
+        printf("Save state %s has version %u, expected %u\n", fileName.c_str(), header->version, SAVESTATE_VERSION);
+        return false;
+    }
+
+    if (file.Size() < (size_t)header->headerSize + header->stateSize)
+    {
+        printf("Save state %s is damaged\n", fileName.c_str());
+        return false;
+    }
+
+    // Version 1 ran a fixed number of opcodes per frame, all of them one cycle
+    uint32_t savedClockRate = header->clockRate;
+    if (header->version == 1)
+    {
+        if (savedClockRate > UINT32_MAX / CycleScheduler::TIMER_RATE)
+        {
+            printf("Save state %s is damaged\n", fileName.c_str());
+            return false;
+        }
+
+        savedClockRate *= CycleScheduler::TIMER_RATE;
+    }
+
+    if (header->romHash != cpu.getRomHash() || header->romSize != cpu.getRomSize())
+    {
+        printf("Save state %s belongs to a different rom\n", fileName.c_str());
+        return false;
+    }
+
+    // The header is a multiple of 8 bytes, the state is aligned within the page aligned mapping
+    const chip8State* state = reinterpret_cast<const chip8State*>(file.Data() + header->headerSize);
+
+    if (chip8::Hash(state, sizeof(chip8State)) != header->checksum)
+    {
+        printf("Save state %s is damaged\n", fileName.c_str());
+        return false;
+    }
+
+    if (header->engine <= (uint32_t)chip8::Engine::Static && header->engine != (uint32_t)cpu.getEngine())
+        cpu.setEngine((chip8::Engine)header->engine);
+
+    cpu.restore(*state);
+    clockRate = savedClockRate;
+
+    return true;
+}
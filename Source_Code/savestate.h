@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "chip8.h"
+
+/*
+// Save states
+//
+// A save state file is a fixed header followed by the raw chip8State block,
+// both in native byte order. Loading maps the file into memory, validates the
+// header and checksum and restores the state straight from the mapping.
+//
+// Bump SAVESTATE_VERSION whenever chip8State or the header changes.
+// Version 1 stored opcodes per frame where clockRate is now, those states
+// load with a clock rate of 60 times that.
+*/
+
+const uint32_t SAVESTATE_VERSION = 2;
+
+struct SaveStateHeader
+{
+    char     magic[4];          // "C8SS"
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t stateSize;
+
+    uint64_t romHash;           // chip8::getRomHash of the rom the state belongs to
+    uint32_t romSize;
+
+    // Settings in use when the state was saved
+    uint32_t engine;
+    uint32_t clockRate;         // CycleScheduler cycles per second
+    uint32_t reserved;
+
+    uint64_t checksum;          // chip8::Hash of the state block
+};
+
+bool SaveState(const std::string& fileName, chip8& cpu, uint32_t clockRate);
+
+// Fails without touching cpu if the file is damaged, from an unknown version
+// or was saved with a different rom. On success the saved engine is selected
+// and the saved clock rate is returned
+bool LoadState(const std::string& fileName, chip8& cpu, uint32_t& clockRate);
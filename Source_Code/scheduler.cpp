@@ -0,0 +1,171 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+CycleScheduler::CycleScheduler()
+{
+    m_ClockRate = 800;
+    m_Uniform = true;
+
+    for (int i = 0; i < (int)Op::Count; i++)
+        m_Costs[i] = 1;
+
+    m_Budget = 0;
+    m_FrameBudget = 0;
+    m_Idle = false;
+
+    m_Cycles = 0;
+    m_Instructions = 0;
+    m_IdleInstructions = 0;
+}
+
+void CycleScheduler::setClockRate(uint32_t cyclesPerSecond)
+{
+    m_ClockRate = cyclesPerSecond;
+}
+
+uint32_t CycleScheduler::getClockRate()
+{
+    return m_ClockRate;
+}
+
+void CycleScheduler::setCost(Op op, uint32_t cycles)
+{
+    if (op >= Op::Count)
+        return;
+
+    m_Costs[(int)op] = std::max<uint32_t>(cycles, 1);
+    m_Uniform = std::all_of(m_Costs, m_Costs + (int)Op::Count, [this](uint32_t cost) { return cost == m_Costs[0]; });
+}
+
+uint32_t CycleScheduler::getCost(Op op)
+{
+    return op < Op::Count ? m_Costs[(int)op] : m_Costs[(int)Op::Unknown];
+}
+
+bool CycleScheduler::isUniform()
+{
+    return m_Uniform;
+}
+
+void CycleScheduler::Reset()
+{
+    m_Budget = 0;
+    m_FrameBudget = 0;
+}
+
+void CycleScheduler::BeginFrame()
+{
+    m_Budget += m_ClockRate;
+    m_FrameBudget = m_Budget;
+}
+
+uint32_t CycleScheduler::Run(chip8& emulator, double part, uint32_t maxInstructions)
+{
+    // What has to stay in the budget for the rest of the frame
+    uint64_t keep = m_FrameBudget - (uint64_t)(m_FrameBudget * std::min(std::max(part, 0.0), 1.0));
+    if (m_Budget <= keep)
+        return 0;
+
+    uint64_t available = m_Budget - keep;
+    uint64_t ran = 0;
+
+    m_Idle = false;
+
+    while (ran < maxInstructions)
+    {
+        Op loop[3];
+        uint32_t length = emulator.getIdleLoop(loop);
+
+        if (length > 0)
+        {
+            uint64_t skipped = IdleOpcodes(loop, length, available, maxInstructions - ran);
+            emulator.SkipIdle(skipped);
+
+            ran += skipped;
+            m_IdleInstructions += skipped;
+            m_Idle = true;
+            break;
+        }
+
+        if (m_Uniform)
+        {
+            uint64_t cost = (uint64_t)m_Costs[0] * TIMER_RATE;
+            uint64_t count = std::min<uint64_t>({ available / cost, maxInstructions - ran, IDLE_CHECK_INTERVAL });
+            if (count == 0)
+                break;
+
+            emulator.Run((unsigned int)count);
+            available -= count * cost;
+            ran += count;
+        }
+        else
+        {
+            uint64_t cost = (uint64_t)m_Costs[(int)g_DecodeTable[emulator.getCurrentOpcode()].op] * TIMER_RATE;
+            if (cost > available)
+                break;
+
+            emulator.Run(1);
+            available -= cost;
+            ran++;
+        }
+    }
+
+    uint64_t spent = m_Budget - keep - available;
+    m_Budget -= spent;
+    m_Cycles += spent / TIMER_RATE;
+    m_Instructions += ran;
+
+    return (uint32_t)ran;
+}
+
+void CycleScheduler::EndFrame(chip8& emulator)
+{
+    emulator.DecreaseTimers();
+}
+
+bool CycleScheduler::isIdle()
+{
+    return m_Idle;
+}
+
+uint64_t CycleScheduler::getCycles()
+{
+    return m_Cycles;
+}
+
+uint64_t CycleScheduler::getInstructions()
+{
+    return m_Instructions;
+}
+
+uint64_t CycleScheduler::getIdleInstructions()
+{
+    return m_IdleInstructions;
+}
+
+/*
+    PRIVATE Functions
+*/
+uint64_t CycleScheduler::IdleOpcodes(const Op* loop, uint32_t length, uint64_t& available, uint64_t maxInstructions)
+{
+    uint64_t turn = 0;
+    for (uint32_t i = 0; i < length; i++)
+        turn += (uint64_t)m_Costs[(int)loop[i]] * TIMER_RATE;
+
+    // Whole turns of the loop, then opcode by opcode for the part of a turn that still fits
+    uint64_t turns = std::min(available / turn, maxInstructions / length);
+    uint64_t opcodes = turns * length;
+    available -= turns * turn;
+
+    for (; opcodes < maxInstructions; opcodes++)
+    {
+        uint64_t cost = (uint64_t)m_Costs[(int)loop[opcodes % length]] * TIMER_RATE;
+        if (cost > available)
+            break;
+
+        available -= cost;
+    }
+
+    return opcodes;
+}
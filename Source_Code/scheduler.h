@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+
+#include "chip8.h"
+
+/*
+// Cycle scheduler
+//
+// Runs the guest at a clock rate in cycles per second instead of a fixed
+// number of opcodes per host frame. Every opcode costs a configurable number
+// of cycles, so a DXYN can take longer than a 6XNN. A frame is one tick of
+// the 60 Hz timers in emulated time: it adds clockRate / 60 cycles to the
+// budget, runs every opcode the budget covers and then fires the timers.
+//
+// The budget is kept in 1/60 cycles, so clock rates that are not a multiple
+// of 60 come out exact over time, and whatever a frame could not spend on
+// its next opcode carries over into the following frame.
+//
+// When all opcodes cost the same the frame goes to chip8::Run in chunks,
+// otherwise the scheduler looks at each opcode before running it. That runs
+// one opcode per chip8::Run, so the BlockCache, Jit and Static engines never
+// get to run a whole block and perform like the Decoded one. Their blocks
+// would have to stop on a cycle budget instead of an opcode count first.
+//
+// Between chunks it checks for idle loops (see chip8::getIdleLoop). Those
+// can not change anything before the next timer tick or key change, so the
+// rest of the budget Run was given is spent on them at once with
+// chip8::SkipIdle and counted as instructions run.
+*/
+
+class CycleScheduler
+{
+public:
+    static const uint32_t TIMER_RATE = 60;
+
+    CycleScheduler();
+
+    void setClockRate(uint32_t cyclesPerSecond);
+    uint32_t getClockRate();
+
+    // Every opcode costs at least one cycle, unknown opcodes included
+    void setCost(Op op, uint32_t cycles);
+    uint32_t getCost(Op op);
+
+    // False once the costs differ, opcodes are then run one at a time
+    bool isUniform();
+
+    // Forgets the carried cycles, e.g. after a frame that was not run to its end
+    void Reset();
+
+    // Adds one timer period worth of cycles to the budget
+    void BeginFrame();
+
+    // Runs opcodes until part of the cycles the frame started with are spent
+    // or maxInstructions ran, returns the opcodes run
+    uint32_t Run(chip8& emulator, double part = 1.0, uint32_t maxInstructions = UINT32_MAX);
+
+    // Fires the timers, the unspent cycles carry into the next frame
+    void EndFrame(chip8& emulator);
+
+    // True if the last Run ended in an idle loop
+    bool isIdle();
+
+    // Totals since construction, the instructions include the idle ones
+    uint64_t getCycles();
+    uint64_t getInstructions();
+    uint64_t getIdleInstructions();
+
+private:
+    // Opcodes checked for idle loops at most this far apart with uniform costs
+    static const uint32_t IDLE_CHECK_INTERVAL = 256;
+
+    uint32_t m_ClockRate;
+    uint32_t m_Costs[(int)Op::Count];
+    bool     m_Uniform;
+
+    // In 1/TIMER_RATE cycles
+    uint64_t m_Budget;
+    uint64_t m_FrameBudget;     // the budget when the frame began
+
+    bool     m_Idle;
+
+    uint64_t m_Cycles;
+    uint64_t m_Instructions;
+    uint64_t m_IdleInstructions;
+
+private:
+    // How many opcodes of the idle loop fit into available and maxInstructions, takes their cycles off available
+    uint64_t IdleOpcodes(const Op* loop, uint32_t length, uint64_t& available, uint64_t maxInstructions);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/*
+// Single producer, single consumer queue
+//
+// A fixed ring of SIZE items with one atomic index per side, so neither
+// thread ever takes a lock or waits for the other. Push fails when the ring
+// is full instead of blocking. Each side keeps a copy of the other side's
+// index and only reloads it when the ring looks full or empty, which keeps
+// the shared cache lines quiet.
+*/
+
+template <typename T, size_t SIZE>
+class SpscQueue
+{
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+public:
+    SpscQueue() : m_Head(0), m_Tail(0)
+    {
+        m_HeadCache = 0;
+        m_TailCache = 0;
+    }
+
+    // Producer thread only, false if the queue is full
+    bool Push(const T& item)
+    {
+        size_t tail = m_Tail.load(std::memory_order_relaxed);
+
+        if (tail - m_HeadCache == SIZE)
+        {
+            m_HeadCache = m_Head.load(std::memory_order_acquire);
+            if (tail - m_HeadCache == SIZE)
+                return false;
+        }
+
+        m_Items[tail & (SIZE - 1)] = item;
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only, false if the queue is empty
+    bool Pop(T& item)
+    {
+        size_t head = m_Head.load(std::memory_order_relaxed);
+
+        if (head == m_TailCache)
+        {
+            m_TailCache = m_Tail.load(std::memory_order_acquire);
+            if (head == m_TailCache)
+                return false;
+        }
+
+        item = m_Items[head & (SIZE - 1)];
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T m_Items[SIZE];
+
+    // Producer and consumer indexes on cache lines of their own
+    alignas(64) std::atomic<size_t> m_Head;
+    size_t m_TailCache;                         // consumer's copy of m_Tail
+
+    alignas(64) std::atomic<size_t> m_Tail;
+    size_t m_HeadCache;                         // producer's copy of m_Head
+};
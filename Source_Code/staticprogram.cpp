@@ -0,0 +1,123 @@
+#include "staticprogram.h"
+#include "chip8.h"
+
+#include <cstring>
+#include <vector>
+
+static std::vector<const StaticProgram*>& Registry()
+{
+    // Function local so generated files can register during static initialization
+    static std::vector<const StaticProgram*> programs;
+    return programs;
+}
+
+bool RegisterStaticProgram(const StaticProgram* program)
+{
+    Registry().push_back(program);
+    return true;
+}
+
+const StaticProgram* FindStaticProgram(const uint8_t* rom, size_t size)
+{
+    for (const StaticProgram* program : Registry())
+    {
+        if (program->romSize == size && memcmp(program->rom, rom, size) == 0)
+            return program;
+    }
+
+    return nullptr;
+}
+
+StaticRecompiled::StaticRecompiled()
+{
+    m_Program = nullptr;
+
+    for (int i = 0; i < 0x1000; i++)
+        m_BlockAt[i] = -1;
+}
+
+bool StaticRecompiled::Load(const uint8_t* rom, size_t size)
+{
+    m_Program = FindStaticProgram(rom, size);
+
+    for (int i = 0; i < 0x1000; i++)
+        m_BlockAt[i] = -1;
+
+    if (!m_Program)
+        return false;
+
+    for (uint32_t i = 0; i < m_Program->blockCount; i++)
+        m_BlockAt[m_Program->blocks[i].address] = (int32_t)i;
+
+    return true;
+}
+
+bool StaticRecompiled::Available()
+{
+    return m_Program != nullptr;
+}
+
+unsigned int StaticRecompiled::Run(chip8& cpu, unsigned int opcodes)
+{
+    if (!m_Program)
+        return opcodes;
+
+    StaticContext context;
+    context.V = cpu.m_State.registers;
+    context.I = &cpu.m_State.addressI;
+    context.delayTimer = &cpu.m_State.delayTimer;
+    context.soundTimer = &cpu.m_State.soundTimer;
+
+    while (opcodes > 0)
+    {
+        uint16_t pc = cpu.m_State.programCounter;
+        int32_t index = pc < 0x1000 ? m_BlockAt[pc] : -1;
+
+        if (index >= 0)
+        {
+            const StaticBlock& block = m_Program->blocks[index];
+
+            // Let the caller single step the rest so the opcode count stays exact
+            if (block.instructionCount > opcodes)
+                break;
+
+            cpu.m_State.programCounter = block.function(context, opcodes);
+            continue;
+        }
+
+        // Untranslated or overwritten code, can write memory and invalidate
+        cpu.ExecuteDecoded();
+        opcodes--;
+    }
+
+    return opcodes;
+}
+
+void StaticRecompiled::Invalidate(const uint8_t* memory, uint16_t address, uint16_t length)
+{
+    if (!m_Program)
+        return;
+
+    uint32_t end = (uint32_t)address + length;
+
+    // Self modified code goes to the interpreter, restored code back to its block
+    for (uint32_t i = 0; i < m_Program->blockCount; i++)
+    {
+        const StaticBlock& block = m_Program->blocks[i];
+
+        if (block.address < end && address < block.end)
+            m_BlockAt[block.address] = Matches(memory, block) ? (int32_t)i : -1;
+    }
+}
+
+/*
+    PRIVATE Functions
+*/
+bool StaticRecompiled::Matches(const uint8_t* memory, const StaticBlock& block)
+{
+    // Blocks are only generated from code inside the ROM
+    if (block.address < 0x200 || block.end > 0x200 + m_Program->romSize)
+        return false;
+
+    return memcmp(&memory[block.address], &m_Program->rom[block.address - 0x200], block.end - block.address) == 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+// Statically recompiled ROMs
+//
+// chip8_recompiler traces the reachable code of a ROM and turns every basic
+// block into a C++ function (see tools/recompiler.cpp). The generated file
+// registers itself with RegisterStaticProgram() and is picked up by loadRom()
+// when the loaded bytes match the ROM it was generated from.
+//
+// A block function runs the block, subtracts the executed instructions from
+// opcodes and returns the next program counter. It is only called when opcodes
+// is at least instructionCount. Everything the recompiler could not translate,
+// computed jumps (BNNN) and blocks whose bytes differ from the ROM at runtime
+// are left to the interpreter. A block is used again as soon as its bytes
+// match the ROM again, e.g. after a rewind or a state load.
+*/
+
+class chip8;
+
+struct StaticContext
+{
+    uint8_t*  V;
+    uint16_t* I;
+    uint8_t*  delayTimer;
+    uint8_t*  soundTimer;
+};
+
+typedef uint16_t (*StaticBlockFunction)(StaticContext& c, unsigned int& opcodes);
+
+struct StaticBlock
+{
+    uint16_t            address;
+    uint16_t            end;                // first byte after the block
+    uint16_t            instructionCount;   // upper bound for one pass through the block
+    StaticBlockFunction function;
+};
+
+struct StaticProgram
+{
+    const char*        name;
+    const uint8_t*     rom;
+    uint32_t           romSize;
+    const StaticBlock* blocks;
+    uint32_t           blockCount;
+};
+
+bool RegisterStaticProgram(const StaticProgram* program);
+const StaticProgram* FindStaticProgram(const uint8_t* rom, size_t size);
+
+class StaticRecompiled
+{
+public:
+    StaticRecompiled();
+
+    // Looks up the program generated for this ROM, returns false if there is none
+    bool Load(const uint8_t* rom, size_t size);
+    bool Available();
+
+    // Runs recompiled blocks and interprets the rest,
+    // returns how many opcodes are still to be executed
+    unsigned int Run(chip8& cpu, unsigned int opcodes);
+
+    // memory is the guest memory after the write
+    void Invalidate(const uint8_t* memory, uint16_t address, uint16_t length);
+
+private:
+    const StaticProgram* m_Program;
+
+    int32_t m_BlockAt[0x1000];  // block index per start address, -1 if there is none
+
+private:
+    // True if memory holds the ROM bytes the block was generated from
+    bool Matches(const uint8_t* memory, const StaticBlock& block);
+};
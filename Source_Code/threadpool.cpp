@@ -0,0 +1,74 @@
+#include "threadpool.h"
+
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(unsigned int workers)
+{
+    if (workers == 0)
+        workers = std::thread::hardware_concurrency();
+
+    m_Workers = workers > 0 ? workers : 1;
+
+    for (unsigned int i = 0; i < m_Workers; i++)
+        m_Queues.emplace_back(new Queue());
+}
+
+unsigned int WorkStealingPool::getWorkers()
+{
+    return m_Workers;
+}
+
+void WorkStealingPool::Run(size_t jobCount, const std::function<void(size_t job, unsigned int worker)>& job)
+{
+    // Deal the jobs out round robin, stealing evens out the rest
+    for (size_t i = 0; i < jobCount; i++)
+        m_Queues[i % m_Workers]->jobs.push_back(i);
+
+    auto work = [&](unsigned int worker)
+    {
+        size_t index;
+        while (Take(worker, index))
+            job(index, worker);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < m_Workers; i++)
+        threads.emplace_back(work, i);
+
+    // The calling thread is worker 0
+    work(0);
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+bool WorkStealingPool::Take(unsigned int worker, size_t& job)
+{
+    {
+        Queue& own = *m_Queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+
+    // No new jobs show up during Run, so all queues empty means done
+    for (unsigned int i = 1; i < m_Workers; i++)
+    {
+        Queue& victim = *m_Queues[(worker + i) % m_Workers];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
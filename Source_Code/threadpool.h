@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+// Work stealing thread pool
+//
+// Every worker owns a queue of job indices and takes from its back, a worker
+// that runs dry steals from the front of the others. Jobs of very different
+// length (a ROM that idles vs. one that draws all the time) still keep every
+// core busy until the batch is done.
+*/
+
+class WorkStealingPool
+{
+public:
+    // 0 uses one worker per hardware thread
+    WorkStealingPool(unsigned int workers = 0);
+
+    unsigned int getWorkers();
+
+    // Runs job(index, worker) for every index below jobCount and returns when all are done
+    void Run(size_t jobCount, const std::function<void(size_t job, unsigned int worker)>& job);
+
+private:
+    struct Queue
+    {
+        std::mutex         lock;
+        std::deque<size_t> jobs;
+    };
+
+    unsigned int m_Workers;
+    std::vector<std::unique_ptr<Queue>> m_Queues;
+
+private:
+    bool Take(unsigned int worker, size_t& job);
+};
@@ -0,0 +1,406 @@
+/*
+// chip8_batch
+//
+// Runs a corpus of ROMs headless, spread over all cores, and writes the final
+// state hash, framebuffer and timing of every job to a JSON file. Jobs are
+// reproducible: the same ROM, input, seed and limits give the same hashes on
+// any engine and any thread count.
+//
+// Usage: chip8_batch [options] <rom.ch8[:input.txt]>...
+//   -frames N         frames to run (60 per second), default 3600
+//   -instructions N   stop after N instructions instead, 0 runs all frames
+//   -opcodes N        opcodes per frame, default 13
+//   -engine NAME      execution engine, default Decoded
+//   -seed N           seed for CXNN, default 1
+//   -threads N        worker threads, default one per hardware thread
+//   -jobs FILE        reads more "rom [input]" jobs from FILE, one per line
+//   -out FILE         results file, default results.json
+//   -profile DIR      writes <job>_<rom>.profile.txt and .folded per job,
+//                     needs a build with CHIP8_PROFILE
+//   -trace DIR        streams every instruction of a job to <job>_<rom>.c8tr
+//   -ring N           keeps only the last N instructions of a job instead and
+//                     writes them to DIR/<job>_<rom>.fault.c8tr on its first fault
+//   -movie DIR        records every job as an input movie <job>_<rom>.c8mv,
+//                     chip8_replay checks them against later builds
+*/
+
+#include "../chip8.h"
+#include "../inputscript.h"
+#include "../movie.h"
+#include "../scheduler.h"
+#include "../threadpool.h"
+#include "../trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+struct BatchJob
+{
+    std::string rom;
+    std::string input;
+};
+
+struct BatchSettings
+{
+    uint32_t      frames = 3600;
+    uint64_t      instructions = 0;
+    uint32_t      opcodesPerFrame = 800 / 60;
+    chip8::Engine engine = chip8::Engine::Decoded;
+    uint32_t      seed = 1;
+    std::string   profileDir;
+    std::string   traceDir;
+    size_t        traceRing = 0;
+    std::string   movieDir;
+};
+
+struct BatchResult
+{
+    bool        ok = false;
+    std::string error;
+    const char* engine = "";    // the one that ran, see chip8::getActiveEngine
+    uint32_t    frames = 0;
+    uint64_t    instructions = 0;
+    uint64_t    faults = 0;
+    double      seconds = 0;
+    uint64_t    stateHash = 0;
+    uint64_t    screenHash = 0;
+    uint64_t    screen[32] = {};
+};
+
+static BatchJob ParseJob(const std::string& text)
+{
+    BatchJob job;
+
+    // rom:input, a single character before the colon is a drive letter
+    size_t colon = text.rfind(':');
+    if (colon != std::string::npos && colon > 1)
+    {
+        job.rom = text.substr(0, colon);
+        job.input = text.substr(colon + 1);
+    }
+    else
+        job.rom = text;
+
+    return job;
+}
+
+static bool LoadJobs(const char* fileName, std::vector<BatchJob>& jobs)
+{
+    std::ifstream in(fileName);
+    if (!in.is_open())
+        return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        BatchJob job;
+        if (fields >> job.rom)
+        {
+            fields >> job.input;
+            jobs.push_back(job);
+        }
+    }
+
+    return true;
+}
+
+// Output files of a job start with its index, so the same rom twice does not collide
+static std::string JobFileName(const std::string& dir, size_t index, const BatchJob& job)
+{
+    return dir + "/" + std::to_string(index) + "_" + std::filesystem::path(job.rom).stem().string();
+}
+
+static void RunJob(size_t index, const BatchJob& job, const BatchSettings& settings, BatchResult& result)
+{
+    std::vector<InputEvent> input;
+    if (!job.input.empty() && !LoadInputScript(job.input, input))
+    {
+        result.error = "could not load input script";
+        return;
+    }
+
+    // Each instance owns its RNG, so nothing is shared between the workers
+    chip8 emulator;
+    emulator.setEngine(settings.engine);
+    emulator.setSeed(settings.seed);
+
+    if (!emulator.loadRom(job.rom))
+    {
+        result.error = "could not load rom";
+        return;
+    }
+
+    result.engine = chip8::EngineName(emulator.getActiveEngine());
+
+    TraceRecorder trace;
+    if (!settings.traceDir.empty())
+    {
+        std::string name = JobFileName(settings.traceDir, index, job);
+
+        if (settings.traceRing > 0)
+            trace.StartRing(settings.traceRing, name + ".fault.c8tr");
+        else if (!trace.StartStream(name + ".c8tr"))
+        {
+            result.error = "could not open trace file";
+            return;
+        }
+
+        emulator.setTrace(&trace);
+    }
+
+    // Frames below are fixed opcode counts, the same as a one cycle per opcode scheduler
+    CycleScheduler scheduler;
+    scheduler.setClockRate(settings.opcodesPerFrame * CycleScheduler::TIMER_RATE);
+
+    MovieRecorder movie;
+    if (!settings.movieDir.empty())
+        movie.Start(emulator, settings.seed, scheduler);
+
+    auto start = std::chrono::steady_clock::now();
+
+    size_t next = 0;
+    for (uint32_t frame = 0; frame < settings.frames; frame++)
+    {
+        for (; next < input.size() && input[next].frame <= frame; next++)
+        {
+            if (input[next].pressed)
+                emulator.KeyPressed(input[next].key);
+            else
+                emulator.KeyReleased(input[next].key);
+
+            movie.Key(input[next].key, input[next].pressed != 0);
+        }
+
+        uint64_t opcodes = settings.opcodesPerFrame;
+        if (settings.instructions > 0)
+        {
+            if (result.instructions >= settings.instructions)
+                break;
+
+            if (opcodes > settings.instructions - result.instructions)
+                opcodes = settings.instructions - result.instructions;
+        }
+
+        emulator.Run((unsigned int)opcodes);
+        result.instructions += opcodes;
+
+        // A partial frame does not reach the timer tick
+        if (opcodes == settings.opcodesPerFrame)
+        {
+            emulator.DecreaseTimers();
+            movie.EndFrame(emulator);
+            result.frames++;
+        }
+    }
+
+    // The stream is flushed before the clock stops, so the timing includes it
+    trace.Stop();
+    result.faults = trace.getFaults();
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (movie.isRecording() && !movie.Stop(JobFileName(settings.movieDir, index, job) + ".c8mv"))
+    {
+        result.error = "could not write movie";
+        return;
+    }
+
+    chip8State state;
+    emulator.snapshot(state);
+    result.stateHash = chip8::Hash(&state, sizeof(state));
+
+    memcpy(result.screen, emulator.getScreenRows(), sizeof(result.screen));
+    result.screenHash = chip8::Hash(result.screen, sizeof(result.screen));
+
+#ifdef CHIP8_PROFILE
+    if (!settings.profileDir.empty())
+    {
+        std::string name = JobFileName(settings.profileDir, index, job);
+
+        emulator.getProfiler().WriteHistogram(name + ".profile.txt");
+        emulator.getProfiler().WriteFoldedStacks(name + ".folded");
+    }
+#endif
+
+    result.ok = true;
+}
+
+static void WriteString(FILE* out, const std::string& text)
+{
+    fputc('"', out);
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            fputc('\\', out);
+        fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static bool WriteResults(const char* fileName, const BatchSettings& settings, unsigned int threads, double seconds,
+                         const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& results)
+{
+    FILE* out = fopen(fileName, "w");
+    if (!out)
+        return false;
+
+    fprintf(out, "{\n  \"engine\": \"%s\",\n  \"seed\": %u,\n  \"opcodesPerFrame\": %u,\n  \"threads\": %u,\n  \"seconds\": %.6f,\n  \"jobs\": [\n",
+            chip8::EngineName(settings.engine), settings.seed, settings.opcodesPerFrame, threads, seconds);
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const BatchResult& result = results[i];
+
+        fprintf(out, "    {\n      \"rom\": ");
+        WriteString(out, jobs[i].rom);
+        fprintf(out, ",\n      \"input\": ");
+        WriteString(out, jobs[i].input);
+
+        if (!result.ok)
+        {
+            fprintf(out, ",\n      \"error\": ");
+            WriteString(out, result.error);
+        }
+        else
+        {
+            fprintf(out, ",\n      \"engine\": \"%s\",\n      \"frames\": %u,\n      \"instructions\": %llu,\n      \"seconds\": %.6f,\n",
+                    result.engine, result.frames, (unsigned long long)result.instructions, result.seconds);
+            if (!settings.traceDir.empty())
+                fprintf(out, "      \"faults\": %llu,\n", (unsigned long long)result.faults);
+            fprintf(out, "      \"stateHash\": \"%016llx\",\n      \"screenHash\": \"%016llx\",\n      \"screen\": [",
+                    (unsigned long long)result.stateHash, (unsigned long long)result.screenHash);
+
+            // One 64 pixel row per entry, most significant bit is x = 0
+            for (int row = 0; row < 32; row++)
+                fprintf(out, "%s\"%016llx\"", row == 0 ? "" : ", ", (unsigned long long)result.screen[row]);
+
+            fprintf(out, "]");
+        }
+
+        fprintf(out, "\n    }%s\n", i + 1 < jobs.size() ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BatchSettings settings;
+    std::vector<BatchJob> jobs;
+    unsigned int threads = 0;
+    const char* outName = "results.json";
+
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        const char* option = argv[arg];
+        const char* value = argv[arg + 1];
+
+        if (strcmp(option, "-frames") == 0)
+            settings.frames = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-instructions") == 0)
+            settings.instructions = strtoull(value, nullptr, 0);
+        else if (strcmp(option, "-opcodes") == 0)
+            settings.opcodesPerFrame = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-seed") == 0)
+            settings.seed = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-threads") == 0)
+            threads = (unsigned int)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-out") == 0)
+            outName = value;
+        else if (strcmp(option, "-trace") == 0)
+            settings.traceDir = value;
+        else if (strcmp(option, "-ring") == 0)
+            settings.traceRing = (size_t)strtoull(value, nullptr, 0);
+        else if (strcmp(option, "-movie") == 0)
+            settings.movieDir = value;
+        else if (strcmp(option, "-profile") == 0)
+        {
+#ifdef CHIP8_PROFILE
+            settings.profileDir = value;
+#else
+            printf("-profile needs a build with CHIP8_PROFILE\n");
+            return 1;
+#endif
+        }
+        else if (strcmp(option, "-engine") == 0)
+        {
+            if (!chip8::EngineFromName(value, settings.engine))
+            {
+                printf("Unknown engine %s\n", value);
+                return 1;
+            }
+        }
+        else if (strcmp(option, "-jobs") == 0)
+        {
+            if (!LoadJobs(value, jobs))
+            {
+                printf("Could not load job list %s\n", value);
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Unknown option %s\n", option);
+            return 1;
+        }
+    }
+
+    for (; arg < argc; arg++)
+        jobs.push_back(ParseJob(argv[arg]));
+
+    if (jobs.empty() || settings.opcodesPerFrame == 0)
+    {
+        printf("Usage: chip8_batch [-frames N] [-instructions N] [-opcodes N] [-engine NAME] [-seed N] [-threads N] [-jobs FILE] [-out FILE] [-trace DIR [-ring N]] [-movie DIR] <rom.ch8[:input.txt]>...\n");
+        return 1;
+    }
+
+    // Without a frame limit the instruction limit decides
+    if (settings.instructions > 0 && settings.frames == 0)
+        settings.frames = UINT32_MAX;
+
+    std::vector<BatchResult> results(jobs.size());
+    WorkStealingPool pool(threads);
+
+    auto start = std::chrono::steady_clock::now();
+
+    pool.Run(jobs.size(), [&](size_t job, unsigned int)
+    {
+        RunJob(job, jobs[job], settings, results[job]);
+    });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int failures = 0;
+    uint64_t instructions = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (!results[i].ok)
+        {
+            printf("%s: %s\n", jobs[i].rom.c_str(), results[i].error.c_str());
+            failures++;
+        }
+        instructions += results[i].instructions;
+    }
+
+    if (!WriteResults(outName, settings, pool.getWorkers(), seconds, jobs, results))
+    {
+        printf("Could not write %s\n", outName);
+        return 1;
+    }
+
+    printf("%zu jobs on %u threads in %.3f s, %.1f MIPS\n", jobs.size(), pool.getWorkers(), seconds,
+           seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+
+    return failures == 0 ? 0 : 1;
+}
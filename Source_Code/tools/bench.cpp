@@ -0,0 +1,581 @@
+/*
+// chip8_bench
+//
+// Measures emulation speed and writes it as JSON, so two builds can be
+// compared by diffing their output. Build with CMAKE_BUILD_TYPE=Release,
+// the "build" field records whether asserts were on.
+//
+// Rom benchmarks run every rom headless for a fixed instruction count under
+// the same generated input and report MIPS and emulated frames per second.
+// The state hash at the end must not change between builds unless behaviour
+// was changed on purpose.
+//
+// Microbenchmarks run small generated roms that repeat one hot opcode
+// (DXYN, 00E0, FX33, FX55, FX65) through the normal Run() path, and time the
+// decode step on its own: the nested switch of ExecuteOpcode() against the
+// table lookup of the other engines.
+//
+// Batch benchmarks run every rom on chip8Batch lanes and on as many chip8
+// instances, each lane with its own random input, compare the final state of
+// every lane with its chip8 and report the throughput of both.
+//
+// Usage: chip8_bench [options] [rom.ch8...]
+//   -engine NAME      execution engine, default Decoded
+//   -instructions N   instructions per rom, default 20000000
+//   -opcodes N        opcodes per frame, default 13
+//   -repeat N         runs per measurement, the fastest counts, default 3
+//   -lanes N          lanes of the batch benchmarks, default 256, 0 skips them
+//   -input FILE       scripted input instead of the generated one
+//   -out FILE         results file, default bench.json
+// Without roms every .ch8 in dependencies/roms is run.
+*/
+
+#include "../chip8.h"
+#include "../chip8batch.h"
+#include "../inputscript.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+struct BenchSettings
+{
+    chip8::Engine engine = chip8::Engine::Decoded;
+    uint64_t      instructions = 20000000;
+    uint32_t      opcodesPerFrame = 800 / 60;
+    uint32_t      repeat = 3;
+    uint32_t      lanes = 256;
+};
+
+struct RomResult
+{
+    std::string name;
+    bool        ok = false;
+    const char* engine = "";    // the one that ran, see chip8::getActiveEngine
+    double      seconds = 0;
+    uint64_t    frames = 0;
+    uint64_t    stateHash = 0;
+};
+
+struct BatchResult
+{
+    std::string name;
+    bool        ok = false;
+    uint64_t    frames = 0;
+    double      batchSeconds = 0;
+    double      scalarSeconds = 0;
+    uint32_t    matchingLanes = 0;
+};
+
+struct MicroResult
+{
+    const char* name;
+    uint64_t    instructions;
+    double      seconds;
+};
+
+static double Now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool ReadFile(const std::string& fileName, std::vector<uint8_t>& data)
+{
+    FILE* in = fopen(fileName.c_str(), "rb");
+    if (!in)
+        return false;
+
+    uint8_t buffer[0x1000];
+    size_t size = fread(buffer, 1, sizeof(buffer), in);
+    fclose(in);
+
+    data.assign(buffer, buffer + size);
+    return true;
+}
+
+// The same input for every run: every 20 frames one key from a fixed
+// sequence is pressed for 6 frames, enough to get past title screens
+static std::vector<InputEvent> GenerateInput(uint64_t frames)
+{
+    std::vector<InputEvent> events;
+
+    uint32_t state = 0x1234567;
+    for (uint64_t frame = 60; frame < frames; frame += 20)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        uint8_t key = state & 0xF;
+        events.push_back({ (uint32_t)frame, key, 1 });
+        events.push_back({ (uint32_t)frame + 6, key, 0 });
+    }
+
+    return events;
+}
+
+static void RunRom(const std::vector<uint8_t>& rom, const std::vector<InputEvent>& input,
+                   const BenchSettings& settings, RomResult& result)
+{
+    for (uint32_t run = 0; run < settings.repeat; run++)
+    {
+        chip8 emulator;
+        emulator.setEngine(settings.engine);
+        emulator.setSeed(1);
+        emulator.loadRom(rom.data(), rom.size());
+        result.engine = chip8::EngineName(emulator.getActiveEngine());
+
+        uint64_t frames = settings.instructions / settings.opcodesPerFrame;
+        size_t next = 0;
+
+        double start = Now();
+        for (uint64_t frame = 0; frame < frames; frame++)
+        {
+            for (; next < input.size() && input[next].frame <= frame; next++)
+            {
+                if (input[next].pressed)
+                    emulator.KeyPressed(input[next].key);
+                else
+                    emulator.KeyReleased(input[next].key);
+            }
+
+            emulator.Run(settings.opcodesPerFrame);
+            emulator.DecreaseTimers();
+        }
+        double seconds = Now() - start;
+
+        if (run == 0 || seconds < result.seconds)
+            result.seconds = seconds;
+
+        chip8State state;
+        emulator.snapshot(state);
+
+        result.frames = frames;
+        result.stateHash = chip8::Hash(&state, sizeof(state));
+    }
+
+    result.ok = true;
+}
+
+// Keys of one lane in one frame: from frame 60 on, every 20 frames a key
+// picked from the lane and the frame is held for 6 frames
+static uint16_t LaneKeys(uint32_t lane, uint64_t frame)
+{
+    if (frame < 60 || frame % 20 >= 6)
+        return 0;
+
+    uint32_t state = (uint32_t)(frame / 20) * 0x9E3779B9u ^ (lane + 1) * 0x85EBCA6Bu;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return (uint16_t)(1 << (state & 0xF));
+}
+
+static void RunBatch(const std::vector<uint8_t>& rom, const BenchSettings& settings, BatchResult& result)
+{
+    uint32_t lanes = settings.lanes;
+
+    // The same instruction count as a rom benchmark, spread over the lanes
+    uint64_t frames = std::max<uint64_t>(settings.instructions / settings.opcodesPerFrame / lanes, 1);
+
+    std::vector<uint16_t> actions(lanes);
+    std::unique_ptr<chip8Batch> batch;
+
+    for (uint32_t run = 0; run < settings.repeat; run++)
+    {
+        batch.reset(new chip8Batch(lanes, settings.opcodesPerFrame));
+        if (!batch->loadRom(rom.data(), rom.size(), 1))
+            return;
+
+        double start = Now();
+        for (uint64_t frame = 0; frame < frames; frame++)
+        {
+            for (uint32_t lane = 0; lane < lanes; lane++)
+                actions[lane] = LaneKeys(lane, frame);
+
+            batch->step(actions.data());
+        }
+        double seconds = Now() - start;
+
+        if (run == 0 || seconds < result.batchSeconds)
+            result.batchSeconds = seconds;
+    }
+
+    // One machine after the other, the way independent copies are usually run
+    std::unique_ptr<chip8[]> machines;
+
+    for (uint32_t run = 0; run < settings.repeat; run++)
+    {
+        machines.reset(new chip8[lanes]);
+
+        double start = Now();
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+            chip8& emulator = machines[lane];
+            emulator.setEngine(settings.engine);
+            emulator.loadRom(rom.data(), rom.size());
+            emulator.setSeed(1 + lane);
+
+            uint16_t keys = 0;
+            for (uint64_t frame = 0; frame < frames; frame++)
+            {
+                uint16_t next = LaneKeys(lane, frame);
+                for (int key = 0; key < 16; key++)
+                {
+                    if ((next >> key & 1) && !(keys >> key & 1))
+                        emulator.KeyPressed(key);
+                    else if (!(next >> key & 1) && (keys >> key & 1))
+                        emulator.KeyReleased(key);
+                }
+                keys = next;
+
+                emulator.Run(settings.opcodesPerFrame);
+                emulator.DecreaseTimers();
+            }
+        }
+        double seconds = Now() - start;
+
+        if (run == 0 || seconds < result.scalarSeconds)
+            result.scalarSeconds = seconds;
+    }
+
+    for (uint32_t lane = 0; lane < lanes; lane++)
+    {
+        chip8State expected, actual;
+        machines[lane].snapshot(expected);
+        batch->getState(lane, actual);
+
+        if (memcmp(&expected, &actual, sizeof(chip8State)) == 0)
+            result.matchingLanes++;
+    }
+
+    result.frames = frames;
+    result.ok = true;
+}
+
+/*
+    Microbenchmark roms
+*/
+
+// Code runs from 0x200 to 0xEFF, sprite data sits at 0xF00 and FX33/FX55
+// store to 0xF80, out of the way of the code
+static const uint16_t SPRITE_DATA = 0xF00;
+static const uint16_t STORE_AREA = 0xF80;
+
+// Prologue once, then the body repeated until the code area is full and a jump back to the first body
+static std::vector<uint8_t> RepeatRom(const std::vector<uint16_t>& prologue, const std::vector<uint16_t>& body)
+{
+    std::vector<uint8_t> rom(0x1000 - 0x200, 0);
+
+    size_t address = 0x200;
+    auto emit = [&](uint16_t opcode)
+    {
+        rom[address - 0x200] = opcode >> 8;
+        rom[address - 0x200 + 1] = opcode & 0xFF;
+        address += 2;
+    };
+
+    for (uint16_t opcode : prologue)
+        emit(opcode);
+
+    uint16_t loop = (uint16_t)address;
+    while (address + 2 * body.size() + 2 <= SPRITE_DATA)
+    {
+        for (uint16_t opcode : body)
+            emit(opcode);
+    }
+    emit(0x1000 | loop);
+
+    for (int i = 0; i < 16; i++)
+        rom[SPRITE_DATA - 0x200 + i] = (i & 1) ? 0xAA : 0x55;
+
+    return rom;
+}
+
+static void RunMicro(const char* name, const std::vector<uint8_t>& rom, const BenchSettings& settings,
+                     std::vector<MicroResult>& results)
+{
+    // Short enough that the slow engines finish quickly, long enough to dwarf the loop jump
+    uint64_t instructions = settings.instructions / 4;
+
+    MicroResult result = { name, instructions, 0 };
+    for (uint32_t run = 0; run < settings.repeat; run++)
+    {
+        chip8 emulator;
+        emulator.setEngine(settings.engine);
+        emulator.loadRom(rom.data(), rom.size());
+
+        double start = Now();
+        for (uint64_t left = instructions; left > 0; )
+        {
+            unsigned int chunk = (unsigned int)std::min<uint64_t>(left, 100000);
+            emulator.Run(chunk);
+            left -= chunk;
+        }
+        double seconds = Now() - start;
+
+        if (run == 0 || seconds < result.seconds)
+            result.seconds = seconds;
+    }
+
+    results.push_back(result);
+}
+
+// Decodes a fixed pseudo random opcode stream, the sum keeps the work alive
+template<typename Decode>
+static void RunDecode(const char* name, Decode decode, const BenchSettings& settings, std::vector<MicroResult>& results)
+{
+    std::vector<uint16_t> opcodes(0x10000);
+    uint32_t state = 0x2545F491;
+    for (uint16_t& opcode : opcodes)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        opcode = (uint16_t)(state >> 16);
+    }
+
+    uint64_t instructions = settings.instructions;
+
+    MicroResult result = { name, instructions, 0 };
+    volatile uint32_t sink = 0;
+
+    for (uint32_t run = 0; run < settings.repeat; run++)
+    {
+        uint32_t sum = 0;
+
+        double start = Now();
+        for (uint64_t i = 0; i < instructions; i++)
+        {
+            Instruction in = decode(opcodes[i & 0xFFFF]);
+            sum += (uint32_t)in.op + in.x + in.nnn;
+        }
+        double seconds = Now() - start;
+
+        sink = sink + sum;
+
+        if (run == 0 || seconds < result.seconds)
+            result.seconds = seconds;
+    }
+
+    results.push_back(result);
+}
+
+static void RunMicros(const BenchSettings& settings, std::vector<MicroResult>& results)
+{
+    uint16_t spriteI = 0xA000 | SPRITE_DATA;
+    uint16_t storeI = 0xA000 | STORE_AREA;
+
+    // V0 = 5, V1 = 3 so the sprite straddles no edge, V2 = 0xFE for a three digit FX33
+    RunMicro("DXYN", RepeatRom({ spriteI, 0x6005, 0x6103 }, { 0xD01F }), settings, results);
+    RunMicro("00E0", RepeatRom({}, { 0x00E0 }), settings, results);
+    RunMicro("FX33", RepeatRom({ storeI, 0x62FE }, { 0xF233 }), settings, results);
+
+    // FX55/FX65 advance I, so every one is paired with an ANNN
+    RunMicro("ANNN+FX55", RepeatRom({}, { storeI, 0xFF55 }), settings, results);
+    RunMicro("ANNN+FX65", RepeatRom({}, { spriteI, 0xFE65 }), settings, results);
+    RunMicro("ANNN", RepeatRom({}, { storeI }), settings, results);
+
+    RunDecode("decode/switch", [](uint16_t opcode) { return DecodeInstruction(opcode); }, settings, results);
+    RunDecode("decode/table", [](uint16_t opcode) { return g_DecodeTable[opcode]; }, settings, results);
+}
+
+static bool WriteResults(const char* fileName, const BenchSettings& settings, const std::vector<RomResult>& roms,
+                         const std::vector<BatchResult>& batches, const std::vector<MicroResult>& micros)
+{
+    FILE* out = fopen(fileName, "w");
+    if (!out)
+        return false;
+
+#ifdef NDEBUG
+    const char* build = "release";
+#else
+    const char* build = "debug";
+#endif
+
+    fprintf(out, "{\n  \"build\": \"%s\",\n  \"engine\": \"%s\",\n  \"instructions\": %llu,\n  \"opcodesPerFrame\": %u,\n  \"roms\": [\n",
+            build, chip8::EngineName(settings.engine), (unsigned long long)settings.instructions, settings.opcodesPerFrame);
+
+    for (size_t i = 0; i < roms.size(); i++)
+    {
+        const RomResult& rom = roms[i];
+        uint64_t instructions = rom.frames * settings.opcodesPerFrame;
+
+        if (rom.ok)
+            fprintf(out, "    { \"rom\": \"%s\", \"engine\": \"%s\", \"mips\": %.2f, \"fps\": %.0f, \"seconds\": %.6f, \"stateHash\": \"%016llx\" }",
+                    rom.name.c_str(), rom.engine, instructions / rom.seconds / 1e6, rom.frames / rom.seconds, rom.seconds,
+                    (unsigned long long)rom.stateHash);
+        else
+            fprintf(out, "    { \"rom\": \"%s\", \"error\": \"could not load rom\" }", rom.name.c_str());
+
+        fprintf(out, "%s\n", i + 1 < roms.size() ? "," : "");
+    }
+
+    fprintf(out, "  ],\n  \"batch\": [\n");
+
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        const BatchResult& batch = batches[i];
+        uint64_t instructions = batch.frames * settings.opcodesPerFrame * settings.lanes;
+
+        if (batch.ok)
+            fprintf(out, "    { \"rom\": \"%s\", \"lanes\": %u, \"frames\": %llu, \"batchMips\": %.2f, \"scalarMips\": %.2f, \"speedup\": %.2f, \"matchingLanes\": %u }",
+                    batch.name.c_str(), settings.lanes, (unsigned long long)batch.frames,
+                    instructions / batch.batchSeconds / 1e6, instructions / batch.scalarSeconds / 1e6,
+                    batch.scalarSeconds / batch.batchSeconds, batch.matchingLanes);
+        else
+            fprintf(out, "    { \"rom\": \"%s\", \"error\": \"could not load rom\" }", batch.name.c_str());
+
+        fprintf(out, "%s\n", i + 1 < batches.size() ? "," : "");
+    }
+
+    fprintf(out, "  ],\n  \"micro\": [\n");
+
+    for (size_t i = 0; i < micros.size(); i++)
+    {
+        const MicroResult& micro = micros[i];
+        fprintf(out, "    { \"name\": \"%s\", \"nsPerInstruction\": %.3f, \"mips\": %.2f }%s\n",
+                micro.name, micro.seconds * 1e9 / micro.instructions, micro.instructions / micro.seconds / 1e6,
+                i + 1 < micros.size() ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchSettings settings;
+    std::vector<InputEvent> input;
+    bool scripted = false;
+    const char* outName = "bench.json";
+
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        const char* option = argv[arg];
+        const char* value = argv[arg + 1];
+
+        if (strcmp(option, "-instructions") == 0)
+            settings.instructions = strtoull(value, nullptr, 0);
+        else if (strcmp(option, "-opcodes") == 0)
+            settings.opcodesPerFrame = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-repeat") == 0)
+            settings.repeat = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-lanes") == 0)
+            settings.lanes = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-out") == 0)
+            outName = value;
+        else if (strcmp(option, "-engine") == 0)
+        {
+            if (!chip8::EngineFromName(value, settings.engine))
+            {
+                printf("Unknown engine %s\n", value);
+                return 1;
+            }
+        }
+        else if (strcmp(option, "-input") == 0)
+        {
+            if (!LoadInputScript(value, input))
+            {
+                printf("Could not load input script %s\n", value);
+                return 1;
+            }
+            scripted = true;
+        }
+        else
+        {
+            printf("Unknown option %s\n", option);
+            return 1;
+        }
+    }
+
+    if (settings.opcodesPerFrame == 0 || settings.repeat == 0 || settings.instructions < settings.opcodesPerFrame)
+    {
+        printf("Usage: chip8_bench [-engine NAME] [-instructions N] [-opcodes N] [-repeat N] [-lanes N] [-input FILE] [-out FILE] [rom.ch8...]\n");
+        return 1;
+    }
+
+    std::vector<std::string> romNames(argv + arg, argv + argc);
+    if (romNames.empty())
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("dependencies/roms", error))
+        {
+            if (entry.path().extension() == ".ch8")
+                romNames.push_back(entry.path().string());
+        }
+        std::sort(romNames.begin(), romNames.end());
+    }
+
+    if (!scripted)
+        input = GenerateInput(settings.instructions / settings.opcodesPerFrame);
+
+    std::vector<RomResult> roms(romNames.size());
+    for (size_t i = 0; i < romNames.size(); i++)
+    {
+        // Only the file name, so results from different checkouts diff cleanly
+        roms[i].name = std::filesystem::path(romNames[i]).filename().string();
+
+        std::vector<uint8_t> rom;
+        if (ReadFile(romNames[i], rom))
+            RunRom(rom, input, settings, roms[i]);
+
+        // Flags roms the selected engine fell back on
+        bool fellBack = roms[i].ok && strcmp(roms[i].engine, chip8::EngineName(settings.engine)) != 0;
+
+        if (roms[i].ok)
+            printf("%-24s %8.2f MIPS%s%s\n", roms[i].name.c_str(), roms[i].frames * settings.opcodesPerFrame / roms[i].seconds / 1e6,
+                   fellBack ? " on " : "", fellBack ? roms[i].engine : "");
+        else
+            printf("%-24s could not load rom\n", roms[i].name.c_str());
+    }
+
+    // Every lane has to end in the same state as its own chip8
+    bool lanesMatch = true;
+
+    std::vector<BatchResult> batches;
+    for (size_t i = 0; i < romNames.size() && settings.lanes > 0; i++)
+    {
+        BatchResult batch;
+        batch.name = roms[i].name;
+
+        std::vector<uint8_t> rom;
+        if (ReadFile(romNames[i], rom))
+            RunBatch(rom, settings, batch);
+
+        if (batch.ok)
+        {
+            uint64_t instructions = batch.frames * settings.opcodesPerFrame * settings.lanes;
+            printf("%-24s %8.2f MIPS batch, %8.2f MIPS %u x chip8, %u/%u lanes match\n", batch.name.c_str(),
+                   instructions / batch.batchSeconds / 1e6, instructions / batch.scalarSeconds / 1e6, settings.lanes,
+                   batch.matchingLanes, settings.lanes);
+
+            lanesMatch = lanesMatch && batch.matchingLanes == settings.lanes;
+        }
+        else
+            printf("%-24s could not load rom\n", batch.name.c_str());
+
+        batches.push_back(batch);
+    }
+
+    std::vector<MicroResult> micros;
+    RunMicros(settings, micros);
+
+    for (const MicroResult& micro : micros)
+        printf("%-24s %8.3f ns\n", micro.name, micro.seconds * 1e9 / micro.instructions);
+
+    if (!WriteResults(outName, settings, roms, batches, micros))
+    {
+        printf("Could not write %s\n", outName);
+        return 1;
+    }
+
+    return lanesMatch ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/*
+// chip8_lockstep
+//
+// Runs every given ROM on the reference interpreter and a candidate engine in
+// lockstep and reports the first instruction where their states differ.
+//
+// Usage: chip8_lockstep [options] <engine> [rom.ch8...]
+//   -frames N     frames to run (60 per second), default 3600
+//   -opcodes N    opcodes per frame, default 13
+//   -interval N   instructions between state compares, default 1000
+//   -seed N       seed for CXNN
+//   -input FILE   scripted input, see LoadInputScript()
+//
+// A built-in ROM runs before the given ones, it tests keys with every VX up
+// to 0xFF while its own input presses and releases a few of them.
+*/
+
+#include "../lockstep.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// V0 counts up forever, V1 counts the EX9E with key V0 up, V2 the EXA1 with it down:
+// 6000 7001 E09E 7101 E0A1 7201 1202
+static const uint8_t s_KeyRom[] = { 0x60, 0x00, 0x70, 0x01, 0xE0, 0x9E, 0x71, 0x01, 0xE0, 0xA1, 0x72, 0x01, 0x12, 0x02 };
+
+static const InputEvent s_KeyInput[] =
+{
+    { 1, 0x3, 1 }, { 2, 0xC, 1 }, { 10, 0x0, 1 }, { 20, 0x3, 0 }, { 30, 0xF, 1 }, { 40, 0xC, 0 }, { 50, 0x0, 0 }
+};
+
+static bool ReadFile(const char* fileName, std::vector<uint8_t>& data)
+{
+    FILE* in = fopen(fileName, "rb");
+    if (!in)
+        return false;
+
+    uint8_t buffer[0x1000];
+    size_t size = fread(buffer, 1, sizeof(buffer), in);
+    fclose(in);
+
+    data.assign(buffer, buffer + size);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    LockstepVerifier::Settings settings;
+    std::vector<InputEvent> input;
+
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        const char* option = argv[arg];
+        const char* value = argv[arg + 1];
+
+        if (strcmp(option, "-frames") == 0)
+            settings.frames = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-opcodes") == 0)
+            settings.opcodesPerFrame = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-interval") == 0)
+            settings.interval = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-seed") == 0)
+            settings.seed = (uint32_t)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-input") == 0)
+        {
+            if (!LoadInputScript(value, input))
+            {
+                printf("Could not load input script %s\n", value);
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Unknown option %s\n", option);
+            return 1;
+        }
+    }
+
+    if (arg >= argc || !chip8::EngineFromName(argv[arg], settings.engine))
+    {
+        printf("Usage: chip8_lockstep [-frames N] [-opcodes N] [-interval N] [-seed N] [-input FILE] <engine> [rom.ch8...]\n");
+        return 1;
+    }
+
+    int failures = 0;
+
+    std::vector<uint8_t> keyRom(s_KeyRom, s_KeyRom + sizeof(s_KeyRom));
+    std::vector<InputEvent> keyInput(s_KeyInput, s_KeyInput + sizeof(s_KeyInput) / sizeof(s_KeyInput[0]));
+
+    LockstepVerifier keyVerifier(keyRom, settings, keyInput);
+    if (keyVerifier.Run())
+        printf("keys past 0xF: ok, %llu instructions\n", (unsigned long long)keyVerifier.getExecuted());
+    else
+    {
+        printf("keys past 0xF: FAILED\n");
+        failures++;
+    }
+
+    for (arg++; arg < argc; arg++)
+    {
+        std::vector<uint8_t> rom;
+        if (!ReadFile(argv[arg], rom))
+        {
+            printf("%s: could not read rom\n", argv[arg]);
+            failures++;
+            continue;
+        }
+
+        LockstepVerifier verifier(rom, settings, input);
+        if (verifier.Run())
+            printf("%s: ok, %llu instructions\n", argv[arg], (unsigned long long)verifier.getExecuted());
+        else
+        {
+            printf("%s: FAILED\n", argv[arg]);
+            failures++;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
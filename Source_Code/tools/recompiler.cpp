@@ -0,0 +1,452 @@
+/*
+// chip8_recompiler
+//
+// Statically recompiles a .ch8 ROM into a C++ translation unit.
+// Reachable code is traced from 0x200 through jumps, calls and skips, every
+// block that starts where the interpreter can hand over control becomes one
+// function. The generated file registers itself on startup, see staticprogram.h.
+//
+// Usage: chip8_recompiler <rom.ch8> <output.cpp> [name]
+*/
+
+#include "../decoder.h"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const int MAX_BLOCK_INSTRUCTIONS = 64;
+
+static uint8_t s_Memory[0x1000];
+static size_t  s_RomSize;
+
+static Instruction Decode(uint16_t address)
+{
+    return g_DecodeTable[(s_Memory[address] << 8) | s_Memory[address + 1]];
+}
+
+static bool IsSkip(Op op)
+{
+    return op == Op::Op3XNN || op == Op::Op4XNN || op == Op::Op5XY0 || op == Op::Op9XY0;
+}
+
+// Same set of opcodes the JIT handles, the rest is left to the interpreter
+static bool IsCompilable(Op op)
+{
+    switch (op)
+    {
+        case Op::Op1NNN:
+        case Op::Op3XNN: case Op::Op4XNN: case Op::Op5XY0: case Op::Op9XY0:
+        case Op::Op6XNN: case Op::Op7XNN:
+        case Op::Op8XY0: case Op::Op8XY1: case Op::Op8XY2: case Op::Op8XY3:
+        case Op::Op8XY4: case Op::Op8XY5: case Op::Op8XY6: case Op::Op8XY7: case Op::Op8XYE:
+        case Op::OpANNN:
+        case Op::OpFX07: case Op::OpFX15: case Op::OpFX18: case Op::OpFX1E: case Op::OpFX29:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static bool InRom(uint32_t address)
+{
+    return address >= 0x200 && address + 1 < 0x200 + s_RomSize;
+}
+
+static std::string Hex(unsigned int value, int digits)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+    return buffer;
+}
+
+static std::string Reg(int index)
+{
+    char buffer[4];
+    snprintf(buffer, sizeof(buffer), "v%X", index);
+    return buffer;
+}
+
+/*
+    Tracing
+*/
+static std::set<uint16_t> s_Entries;
+
+static void Trace()
+{
+    std::set<uint16_t> visited;
+    std::vector<uint16_t> work;
+
+    work.push_back(0x200);
+    s_Entries.insert(0x200);
+
+    auto follow = [&](uint32_t address, bool entry)
+    {
+        if (!InRom(address))
+            return;
+
+        if (entry)
+            s_Entries.insert((uint16_t)address);
+
+        if (visited.insert((uint16_t)address).second)
+            work.push_back((uint16_t)address);
+    };
+
+    while (!work.empty())
+    {
+        uint16_t pc = work.back();
+        work.pop_back();
+
+        Instruction in = Decode(pc);
+
+        switch (in.op)
+        {
+            case Op::Op00EE:
+                break;
+
+            case Op::Op1NNN:
+                follow(in.nnn, true);
+                break;
+
+            case Op::Op2NNN:
+                follow(in.nnn, true);
+                follow(pc + 2, true);
+                break;
+
+            case Op::OpBNNN:
+                // Computed jump, the interpreter handles wherever it lands
+                break;
+
+            case Op::Op3XNN: case Op::Op4XNN: case Op::Op5XY0: case Op::Op9XY0:
+            case Op::OpEX9E: case Op::OpEXA1:
+                follow(pc + 2, true);
+                follow(pc + 4, true);
+                break;
+
+            default:
+                // Control comes back from the interpreter after anything not compiled
+                follow(pc + 2, !IsCompilable(in.op));
+                break;
+        }
+    }
+}
+
+/*
+    Code generation
+*/
+struct GeneratedBlock
+{
+    uint16_t    address;
+    uint16_t    end;
+    int         instructionCount;
+    std::string code;
+};
+
+static std::string Statement(const Instruction& in)
+{
+    std::string x = Reg(in.x), y = Reg(in.y), nn = Hex(in.nn, 2), nnn = Hex(in.nnn, 3);
+
+    switch (in.op)
+    {
+        case Op::Op6XNN: return x + " = " + nn + ";";
+        case Op::Op7XNN: return x + " += " + nn + ";";
+        case Op::Op8XY0: return x + " = " + y + ";";
+        case Op::Op8XY1: return x + " |= " + y + ";";
+        case Op::Op8XY2: return x + " &= " + y + ";";
+        case Op::Op8XY3: return x + " ^= " + y + ";";
+        case Op::Op8XY4: return "vF = 0; if (" + x + " + " + y + " > 255) vF = 1; " + x + " = " + x + " + " + y + ";";
+        case Op::Op8XY5: return "{ vF = 0; uint8_t xval = " + x + ", yval = " + y + "; if (xval > yval) vF = 1; " + x + " = xval - yval; }";
+        case Op::Op8XY6: return "vF = " + x + " & 0x1; " + x + " >>= 1;";
+        case Op::Op8XY7: return "{ vF = 0; uint8_t xval = " + x + ", yval = " + y + "; if (xval < yval) vF = 1; " + x + " = yval - xval; }";
+        case Op::Op8XYE: return "vF = " + x + " >> 7; " + x + " <<= 1;";
+        case Op::OpANNN: return "i = " + nnn + ";";
+        case Op::OpFX07: return x + " = *c.delayTimer;";
+        case Op::OpFX15: return "*c.delayTimer = " + x + ";";
+        case Op::OpFX18: return "*c.soundTimer = " + x + ";";
+        case Op::OpFX1E: return "i = i + " + x + ";";
+        case Op::OpFX29: return "i = " + x + " * 5;";
+        default: return "";
+    }
+}
+
+static std::string Condition(const Instruction& in)
+{
+    std::string x = Reg(in.x), y = Reg(in.y), nn = Hex(in.nn, 2);
+
+    switch (in.op)
+    {
+        case Op::Op3XNN: return x + " == " + nn;
+        case Op::Op4XNN: return x + " != " + nn;
+        case Op::Op5XY0: return in.x == in.y ? "true" : x + " == " + y;
+        case Op::Op9XY0: return in.x == in.y ? "false" : x + " != " + y;
+        default: return "false";
+    }
+}
+
+static void Uses(const Instruction& in, bool read[17], bool written[17])
+{
+    switch (in.op)
+    {
+        case Op::Op3XNN: case Op::Op4XNN: case Op::OpFX15: case Op::OpFX18:
+            read[in.x] = true;
+            break;
+
+        case Op::Op5XY0: case Op::Op9XY0:
+            // Comparing a register with itself is folded into a constant
+            if (in.x != in.y)
+                read[in.x] = read[in.y] = true;
+            break;
+
+        case Op::Op6XNN: case Op::OpFX07:
+            written[in.x] = true;
+            break;
+
+        case Op::Op7XNN:
+            read[in.x] = written[in.x] = true;
+            break;
+
+        case Op::Op8XY0: case Op::Op8XY1: case Op::Op8XY2: case Op::Op8XY3:
+            read[in.x] = read[in.y] = written[in.x] = true;
+            break;
+
+        case Op::Op8XY4: case Op::Op8XY5: case Op::Op8XY7:
+            read[in.x] = read[in.y] = written[in.x] = true;
+            read[0xF] = written[0xF] = true;
+            break;
+
+        case Op::Op8XY6: case Op::Op8XYE:
+            read[in.x] = written[in.x] = true;
+            read[0xF] = written[0xF] = true;
+            break;
+
+        case Op::OpANNN:
+            written[16] = true;
+            break;
+
+        case Op::OpFX1E: case Op::OpFX29:
+            read[in.x] = true;
+            read[16] = written[16] = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+static bool Generate(uint16_t address, GeneratedBlock& block)
+{
+    if (!IsCompilable(Decode(address).op))
+        return false;
+
+    std::vector<std::pair<uint16_t, Instruction>> list;
+    enum { FALLTHROUGH, JUMP, SKIP, SKIP_JUMP } blockExit = FALLTHROUGH;
+
+    uint16_t pc = address;
+    while ((int)list.size() < MAX_BLOCK_INSTRUCTIONS && InRom(pc))
+    {
+        Instruction in = Decode(pc);
+        if (!IsCompilable(in.op))
+            break;
+
+        list.push_back(std::make_pair(pc, in));
+
+        if (in.op == Op::Op1NNN)
+        {
+            blockExit = JUMP;
+            break;
+        }
+
+        if (IsSkip(in.op))
+        {
+            blockExit = SKIP;
+            if (InRom(pc + 2) && Decode(pc + 2).op == Op::Op1NNN)
+            {
+                list.push_back(std::make_pair(pc + 2, Decode(pc + 2)));
+                blockExit = SKIP_JUMP;
+            }
+            break;
+        }
+
+        pc += 2;
+    }
+
+    int count = (int)list.size();
+    int body = blockExit == FALLTHROUGH ? count : blockExit == SKIP_JUMP ? count - 2 : count - 1;
+    int maxCount = count;
+    int fixedCount = blockExit == SKIP_JUMP ? count - 1 : count;
+
+    const Instruction& last = list[body < count ? body : count - 1].second;
+    uint16_t lastPc = list[body < count ? body : count - 1].first;
+
+    // Possible exits, a block that can exit to itself becomes a native loop
+    std::vector<uint16_t> exits;
+    switch (blockExit)
+    {
+        case FALLTHROUGH: exits.push_back(pc); break;
+        case JUMP: exits.push_back(last.nnn); break;
+        case SKIP: exits.push_back(lastPc + 2); exits.push_back(lastPc + 4); break;
+        case SKIP_JUMP: exits.push_back(list[count - 1].second.nnn); exits.push_back(lastPc + 4); break;
+    }
+
+    bool loops = false;
+    for (uint16_t exit : exits)
+        loops = loops || exit == address;
+
+    bool read[17] = {}, written[17] = {};
+    for (int i = 0; i < count; i++)
+        Uses(list[i].second, read, written);
+
+    // Blocks that touch no register, I or timer leave the context unnamed, -Wunused-parameter
+    bool usesContext = false;
+    for (int r = 0; r <= 16; r++)
+        usesContext = usesContext || read[r] || written[r];
+    for (int i = 0; i < count; i++)
+    {
+        Op op = list[i].second.op;
+        usesContext = usesContext || op == Op::OpFX07 || op == Op::OpFX15 || op == Op::OpFX18;
+    }
+
+    std::ostringstream out;
+    out << "uint16_t Block_" << Hex(address, 3).substr(2) << (usesContext ? "(StaticContext& c" : "(StaticContext&") << ", unsigned int& opcodes)\n";
+    out << "{\n";
+
+    for (int r = 0; r < 16; r++)
+        if (read[r] || written[r])
+            out << "    uint8_t " << Reg(r) << " = c.V[" << Hex(r, 1) << "];\n";
+    if (read[16] || written[16])
+        out << "    uint16_t i = *c.I;\n";
+    out << "    uint16_t next;\n\n";
+
+    std::string indent = loops ? "        " : "    ";
+    if (loops)
+        out << "    for (;;)\n    {\n";
+
+    for (int i = 0; i < body; i++)
+    {
+        out << indent << "// " << Hex(list[i].first, 3) << ": " << Hex((s_Memory[list[i].first] << 8) | s_Memory[list[i].first + 1], 4) << "\n";
+        out << indent << Statement(list[i].second) << "\n";
+    }
+
+    out << indent << "opcodes -= " << fixedCount << ";\n";
+
+    switch (blockExit)
+    {
+        case FALLTHROUGH:
+            out << indent << "next = " << Hex(pc, 3) << ";\n";
+            break;
+
+        case JUMP:
+            out << indent << "next = " << Hex(last.nnn, 3) << ";\n";
+            break;
+
+        case SKIP:
+            out << indent << "next = (" << Condition(last) << ") ? " << Hex(lastPc + 4, 3) << " : " << Hex(lastPc + 2, 3) << ";\n";
+            break;
+
+        case SKIP_JUMP:
+            out << indent << "if (" << Condition(last) << ")\n";
+            out << indent << "    next = " << Hex(lastPc + 4, 3) << ";\n";
+            out << indent << "else\n";
+            out << indent << "{\n";
+            out << indent << "    next = " << Hex(list[count - 1].second.nnn, 3) << ";\n";
+            out << indent << "    opcodes -= 1;\n";
+            out << indent << "}\n";
+            break;
+    }
+
+    if (loops)
+    {
+        out << "\n        if (next != " << Hex(address, 3) << " || opcodes < " << maxCount << ")\n";
+        out << "            break;\n";
+        out << "    }\n";
+    }
+
+    out << "\n";
+    for (int r = 0; r < 16; r++)
+        if (written[r])
+            out << "    c.V[" << Hex(r, 1) << "] = " << Reg(r) << ";\n";
+    if (written[16])
+        out << "    *c.I = i;\n";
+    out << "    return next;\n";
+    out << "}\n";
+
+    block.address = address;
+    block.end = list[count - 1].first + 2;
+    block.instructionCount = maxCount;
+    block.code = out.str();
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: chip8_recompiler <rom.ch8> <output.cpp> [name]\n");
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        printf("Could not open %s\n", argv[1]);
+        return 1;
+    }
+
+    s_RomSize = fread(&s_Memory[0x200], 1, sizeof(s_Memory) - 0x200, in);
+    fclose(in);
+
+    std::string name = argc > 3 ? argv[3] : "rom";
+
+    Trace();
+
+    std::vector<GeneratedBlock> blocks;
+    for (uint16_t entry : s_Entries)
+    {
+        GeneratedBlock block;
+        if (Generate(entry, block))
+            blocks.push_back(block);
+    }
+
+    std::ofstream out(argv[2]);
+    if (!out)
+    {
+        printf("Could not write %s\n", argv[2]);
+        return 1;
+    }
+
+    out << "// Generated by chip8_recompiler from " << name << ", do not edit\n\n";
+    out << "#include \"staticprogram.h\"\n\n";
+    out << "namespace\n{\n\n";
+
+    out << "const uint8_t s_Rom[] =\n{";
+    for (size_t i = 0; i < s_RomSize; i++)
+        out << (i % 16 == 0 ? "\n    " : " ") << Hex(s_Memory[0x200 + i], 2) << ",";
+    out << "\n};\n\n";
+
+    for (const GeneratedBlock& block : blocks)
+        out << block.code << "\n";
+
+    out << "const StaticBlock s_Blocks[] =\n{\n";
+    for (const GeneratedBlock& block : blocks)
+    {
+        out << "    { " << Hex(block.address, 3) << ", " << Hex(block.end, 3) << ", " << block.instructionCount
+            << ", Block_" << Hex(block.address, 3).substr(2) << " },\n";
+    }
+    out << "};\n\n";
+
+    out << "const StaticProgram s_Program =\n{\n";
+    out << "    \"" << name << "\", s_Rom, sizeof(s_Rom), s_Blocks, sizeof(s_Blocks) / sizeof(s_Blocks[0])\n";
+    out << "};\n\n";
+
+    out << "const bool s_Registered = RegisterStaticProgram(&s_Program);\n\n";
+    out << "}\n";
+
+    printf("Recompiled %s: %d blocks\n", name.c_str(), (int)blocks.size());
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+// chip8_replay
+//
+// Replays input movies headless and as fast as possible, checking the state
+// hashes stored in them. Exits with 1 if any movie desyncs, so a set of
+// recorded movies works as a regression test and as a benchmark workload.
+//
+// Usage: chip8_replay [options] <movie.c8mv>...
+//   -engine NAME   execution engine, default Decoded
+//   -repeat N      replays every movie N times and reports the fastest, default 1
+*/
+
+#include "../movie.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+    chip8::Engine engine = chip8::Engine::Decoded;
+    unsigned int repeat = 1;
+
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        const char* option = argv[arg];
+        const char* value = argv[arg + 1];
+
+        if (strcmp(option, "-repeat") == 0)
+            repeat = (unsigned int)strtoul(value, nullptr, 0);
+        else if (strcmp(option, "-engine") == 0)
+        {
+            if (!chip8::EngineFromName(value, engine))
+            {
+                printf("Unknown engine %s\n", value);
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Unknown option %s\n", option);
+            return 1;
+        }
+    }
+
+    if (arg >= argc || repeat == 0)
+    {
+        printf("Usage: chip8_replay [-engine NAME] [-repeat N] <movie.c8mv>...\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (; arg < argc; arg++)
+    {
+        Movie movie;
+        if (!movie.Load(argv[arg]))
+        {
+            printf("%s: could not load movie\n", argv[arg]);
+            failures++;
+            continue;
+        }
+
+        double best = 0;
+        bool desynced = false;
+        uint32_t frame = 0;
+        uint64_t instructions = 0;
+        chip8::Engine active = engine;
+
+        for (unsigned int i = 0; i < repeat && !desynced; i++)
+        {
+            chip8 emulator;
+            emulator.setEngine(engine);
+
+            MoviePlayer player;
+            if (!player.Start(emulator, movie))
+            {
+                desynced = true;
+                break;
+            }
+
+            active = emulator.getActiveEngine();
+
+            auto start = std::chrono::steady_clock::now();
+
+            while (player.RunFrame(emulator))
+                ;
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (i == 0 || seconds < best)
+                best = seconds;
+
+            desynced = player.hasDesynced();
+            frame = player.getFrame();
+            instructions = player.getInstructions();
+        }
+
+        if (desynced)
+        {
+            printf("%s: DESYNC at frame %u\n", argv[arg], frame);
+            failures++;
+        }
+        else
+        {
+            printf("%s: ok, %u frames, %zu events in %.3f s, %.0fx real time, %.1f MIPS on %s\n", argv[arg], movie.frames,
+                   movie.events.size(), best, best > 0 ? movie.frames / 60.0 / best : 0.0, best > 0 ? instructions / best / 1e6 : 0.0,
+                   chip8::EngineName(active));
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
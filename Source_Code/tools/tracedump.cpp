@@ -0,0 +1,236 @@
+/*
+// chip8_tracedump
+//
+// Prints a trace written by TraceRecorder, one instruction per line with
+// everything it changed:
+//
+//   1042  0x2A4  D015  DXYN   VF=00
+//   1043  0x2A6  F233  FX33   [0x300]=01 02 07
+//
+// Usage: chip8_tracedump [options] <trace.c8tr>
+//   -from N     skips instructions before index N
+//   -count N    stops after N instructions
+//   -faults N   1 prints only the instructions that faulted
+//   -summary N  1 prints instruction and fault counts per opcode at the end
+*/
+
+#include "../decoder.h"
+#include "../trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct TraceEntry
+{
+    uint8_t  flags = 0;
+    uint16_t pc = 0;
+    uint16_t opcode = 0;
+
+    uint16_t mask = 0;
+    uint8_t  registers[16] = {};
+    uint16_t addressI = 0;
+    uint16_t address = 0;
+    uint8_t  length = 0;
+    uint8_t  memory[16] = {};
+    uint8_t  stackPointer = 0;
+    uint8_t  delayTimer = 0;
+    uint8_t  soundTimer = 0;
+    TraceFault fault = TraceFault::None;
+};
+
+static bool ReadBytes(FILE* in, void* data, size_t size)
+{
+    return fread(data, 1, size, in) == size;
+}
+
+static bool ReadEntry(FILE* in, TraceEntry& entry)
+{
+    entry = TraceEntry();
+
+    if (!ReadBytes(in, &entry.flags, 1) || !ReadBytes(in, &entry.pc, 2) || !ReadBytes(in, &entry.opcode, 2))
+        return false;
+
+    if (entry.flags & TRACE_REGISTERS)
+    {
+        if (!ReadBytes(in, &entry.mask, 2))
+            return false;
+
+        for (int i = 0; i < 16; i++)
+        {
+            if ((entry.mask & (1 << i)) && !ReadBytes(in, &entry.registers[i], 1))
+                return false;
+        }
+    }
+
+    if ((entry.flags & TRACE_INDEX) && !ReadBytes(in, &entry.addressI, 2))
+        return false;
+
+    if (entry.flags & TRACE_MEMORY)
+    {
+        if (!ReadBytes(in, &entry.address, 2) || !ReadBytes(in, &entry.length, 1) || entry.length > 16)
+            return false;
+
+        if (!ReadBytes(in, entry.memory, entry.length))
+            return false;
+    }
+
+    if ((entry.flags & TRACE_STACK) && !ReadBytes(in, &entry.stackPointer, 1))
+        return false;
+
+    if (entry.flags & TRACE_TIMERS)
+    {
+        if (!ReadBytes(in, &entry.delayTimer, 1) || !ReadBytes(in, &entry.soundTimer, 1))
+            return false;
+    }
+
+    if (entry.flags & TRACE_FAULT)
+    {
+        uint8_t fault;
+        if (!ReadBytes(in, &fault, 1))
+            return false;
+
+        entry.fault = (TraceFault)fault;
+    }
+
+    return true;
+}
+
+static void PrintEntry(uint64_t index, const TraceEntry& entry)
+{
+    printf("%8llu  0x%03X  %04X  %-6s", (unsigned long long)index, entry.pc, entry.opcode, OpName(DecodeInstruction(entry.opcode).op));
+
+    for (int i = 0; i < 16; i++)
+    {
+        if (entry.mask & (1 << i))
+            printf(" V%X=%02X", i, entry.registers[i]);
+    }
+
+    if (entry.flags & TRACE_INDEX)
+        printf(" I=0x%03X", entry.addressI);
+
+    if (entry.flags & TRACE_MEMORY)
+    {
+        printf(" [0x%03X]=", entry.address);
+        for (int i = 0; i < entry.length; i++)
+            printf("%s%02X", i == 0 ? "" : " ", entry.memory[i]);
+    }
+
+    if (entry.flags & TRACE_STACK)
+        printf(" SP=%u", entry.stackPointer);
+
+    if (entry.flags & TRACE_TIMERS)
+        printf(" DT=%02X ST=%02X", entry.delayTimer, entry.soundTimer);
+
+    if (entry.flags & TRACE_FAULT)
+        printf("  FAULT: %s", TraceFaultName(entry.fault));
+
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t from = 0;
+    uint64_t count = UINT64_MAX;
+    bool faultsOnly = false;
+    bool summary = false;
+
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        const char* option = argv[arg];
+        const char* value = argv[arg + 1];
+
+        if (strcmp(option, "-from") == 0)
+            from = strtoull(value, nullptr, 0);
+        else if (strcmp(option, "-count") == 0)
+            count = strtoull(value, nullptr, 0);
+        else if (strcmp(option, "-faults") == 0)
+            faultsOnly = strtoul(value, nullptr, 0) != 0;
+        else if (strcmp(option, "-summary") == 0)
+            summary = strtoul(value, nullptr, 0) != 0;
+        else
+        {
+            printf("Unknown option %s\n", option);
+            return 1;
+        }
+    }
+
+    if (arg + 1 != argc)
+    {
+        printf("Usage: chip8_tracedump [-from N] [-count N] [-faults 1] [-summary 1] <trace.c8tr>\n");
+        return 1;
+    }
+
+    FILE* in = fopen(argv[arg], "rb");
+    if (!in)
+    {
+        printf("Could not open %s\n", argv[arg]);
+        return 1;
+    }
+
+    TraceHeader header;
+    if (!ReadBytes(in, &header, sizeof(header)) || memcmp(header.magic, "C8TR", 4) != 0 || header.headerSize < sizeof(header))
+    {
+        printf("%s is not a trace\n", argv[arg]);
+        fclose(in);
+        return 1;
+    }
+
+    if (header.version != TraceRecorder::VERSION)
+    {
+        printf("%s is trace version %u, expected %u\n", argv[arg], header.version, TraceRecorder::VERSION);
+        fclose(in);
+        return 1;
+    }
+
+    fseek(in, header.headerSize, SEEK_SET);
+
+    std::vector<uint64_t> opCounts((size_t)Op::Count, 0);
+    std::vector<uint64_t> faultCounts((size_t)Op::Count, 0);
+
+    uint64_t index = header.first;
+    uint64_t printed = 0;
+    bool truncated = false;
+
+    TraceEntry entry;
+    for (; printed < count; index++)
+    {
+        long position = ftell(in);
+        if (!ReadEntry(in, entry))
+        {
+            // Running out of data before the first byte is the regular end
+            truncated = ftell(in) != position;
+            break;
+        }
+
+        Op op = DecodeInstruction(entry.opcode).op;
+        opCounts[(size_t)op]++;
+        if (entry.flags & TRACE_FAULT)
+            faultCounts[(size_t)op]++;
+
+        if (index < from || (faultsOnly && !(entry.flags & TRACE_FAULT)))
+            continue;
+
+        PrintEntry(index, entry);
+        printed++;
+    }
+
+    fclose(in);
+
+    if (truncated)
+        printf("Trace ends in the middle of instruction %llu\n", (unsigned long long)index);
+
+    if (summary)
+    {
+        printf("\n# opcode      count   faults\n");
+        for (size_t op = 0; op < opCounts.size(); op++)
+        {
+            if (opCounts[op] > 0)
+                printf("%-8s %10llu %8llu\n", OpName((Op)op), (unsigned long long)opCounts[op], (unsigned long long)faultCounts[op]);
+        }
+    }
+
+    return 0;
+}
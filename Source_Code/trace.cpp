@@ -0,0 +1,332 @@
+#include "trace.h"
+
+#include <cstring>
+
+// Buffers queued for the writer before recording waits for it
+static const size_t MAX_PENDING = 8;
+
+const char* TraceFaultName(TraceFault fault)
+{
+    switch (fault)
+    {
+        case TraceFault::None: return "none";
+        case TraceFault::UnknownOpcode: return "unknown opcode";
+        case TraceFault::StackOverflow: return "stack overflow";
+        case TraceFault::StackUnderflow: return "stack underflow";
+    }
+
+    return "unknown fault";
+}
+
+static int LowestBit(uint32_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(bits);
+#else
+    int bit = 0;
+    for (; !(bits & 1); bits >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+// One bit per non-zero byte of x, byte 0 in bit 0 on little endian hosts
+static uint32_t ChangedBytes(uint64_t x)
+{
+    uint64_t high = (((x & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | x) & 0x8080808080808080ull;
+    return (uint32_t)(((high >> 7) * 0x0102040810204080ull) >> 56);
+}
+
+static void WriteHeader(FILE* out, uint64_t first)
+{
+    TraceHeader header = { { 'C', '8', 'T', 'R' }, TraceRecorder::VERSION, sizeof(TraceHeader), first };
+    fwrite(&header, sizeof(header), 1, out);
+}
+
+TraceRecorder::TraceRecorder()
+{
+    m_Mode = Mode::Off;
+    m_Instructions = 0;
+    m_Faults = 0;
+
+    m_Slots = 0;
+    m_Next = 0;
+    m_Dumped = false;
+
+    m_File = nullptr;
+    m_Used = 0;
+    m_Stopping = false;
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    Stop();
+}
+
+void TraceRecorder::StartRing(size_t instructions, const std::string& faultFile)
+{
+    Stop();
+
+    m_Slots = instructions > 0 ? instructions : 1;
+    m_Ring.assign(m_Slots * SLOT, 0);
+    m_Next = 0;
+    m_FaultFile = faultFile;
+    m_Dumped = false;
+
+    m_Instructions = 0;
+    m_Faults = 0;
+    m_Mode = Mode::Ring;
+}
+
+bool TraceRecorder::StartStream(const std::string& fileName)
+{
+    Stop();
+
+    m_File = fopen(fileName.c_str(), "wb");
+    if (!m_File)
+    {
+        printf("Could not open trace file %s\n", fileName.c_str());
+        return false;
+    }
+
+    WriteHeader(m_File, 0);
+
+    m_Buffer.assign(BUFFER_SIZE, 0);
+    m_Used = 0;
+    m_Stopping = false;
+    m_Writer = std::thread(&TraceRecorder::WriterLoop, this);
+
+    m_Instructions = 0;
+    m_Faults = 0;
+    m_Mode = Mode::Stream;
+    return true;
+}
+
+void TraceRecorder::Stop()
+{
+    if (m_Mode == Mode::Stream)
+    {
+        Submit();
+
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            m_Stopping = true;
+        }
+        m_Wake.notify_one();
+        m_Writer.join();
+
+        fclose(m_File);
+        m_File = nullptr;
+
+        m_Pending.clear();
+        m_Free.clear();
+    }
+
+    // A ring stays readable by Dump() after it stopped recording
+    if (m_Mode != Mode::Ring)
+        m_Ring.clear();
+
+    m_Mode = Mode::Off;
+}
+
+bool TraceRecorder::Dump(const std::string& fileName)
+{
+    if (m_Ring.empty())
+        return false;
+
+    FILE* out = fopen(fileName.c_str(), "wb");
+    if (!out)
+        return false;
+
+    size_t count = m_Instructions < m_Slots ? (size_t)m_Instructions : m_Slots;
+    size_t slot = (m_Next + m_Slots - count) % m_Slots;
+
+    WriteHeader(out, m_Instructions - count);
+
+    for (size_t i = 0; i < count; i++, slot = (slot + 1) % m_Slots)
+    {
+        const uint8_t* record = &m_Ring[slot * SLOT];
+        fwrite(record + 1, 1, record[0], out);
+    }
+
+    fclose(out);
+    return true;
+}
+
+bool TraceRecorder::isRecording()
+{
+    return m_Mode != Mode::Off;
+}
+
+uint64_t TraceRecorder::getInstructions()
+{
+    return m_Instructions;
+}
+
+uint64_t TraceRecorder::getFaults()
+{
+    return m_Faults;
+}
+
+void TraceRecorder::Record(uint16_t pc, uint16_t opcode, const TraceBefore& before, const chip8State& after, TraceFault fault)
+{
+    if (m_Mode == Mode::Ring)
+    {
+        uint8_t* slot = &m_Ring[m_Next * SLOT];
+        slot[0] = (uint8_t)Encode(slot + 1, pc, opcode, before, after, fault);
+
+        m_Next = m_Next + 1 == m_Slots ? 0 : m_Next + 1;
+    }
+    else if (m_Mode == Mode::Stream)
+    {
+        m_Used += Encode(&m_Buffer[m_Used], pc, opcode, before, after, fault);
+
+        if (m_Used + MAX_RECORD > BUFFER_SIZE)
+            Submit();
+    }
+    else
+        return;
+
+    m_Instructions++;
+
+    if (fault != TraceFault::None)
+    {
+        m_Faults++;
+
+        // Only the first fault is dumped, later ones are usually its consequences
+        if (m_Mode == Mode::Ring && !m_Dumped && !m_FaultFile.empty())
+        {
+            m_Dumped = true;
+
+            if (Dump(m_FaultFile))
+                printf("Trace: %s at 0x%03X, last %llu instructions written to %s\n", TraceFaultName(fault), pc,
+                       (unsigned long long)(m_Instructions < m_Slots ? m_Instructions : m_Slots), m_FaultFile.c_str());
+        }
+    }
+}
+
+/*
+    PRIVATE Functions
+*/
+size_t TraceRecorder::Encode(uint8_t* out, uint16_t pc, uint16_t opcode, const TraceBefore& before, const chip8State& after, TraceFault fault)
+{
+    uint8_t flags = fault != TraceFault::None ? TRACE_FAULT : 0;
+    size_t size = 5;
+
+    memcpy(out + 1, &pc, 2);
+    memcpy(out + 3, &opcode, 2);
+
+    uint64_t old[2], now[2];
+    memcpy(old, before.registers, 16);
+    memcpy(now, after.registers, 16);
+
+    uint16_t mask = (uint16_t)(ChangedBytes(old[0] ^ now[0]) | ChangedBytes(old[1] ^ now[1]) << 8);
+
+    if (mask)
+    {
+        flags |= TRACE_REGISTERS;
+        memcpy(out + size, &mask, 2);
+        size += 2;
+
+        // Usually one register, so walk the set bits instead of all 16
+        for (uint32_t bits = mask; bits != 0; bits &= bits - 1)
+            out[size++] = after.registers[LowestBit(bits)];
+    }
+
+    if (before.addressI != after.addressI)
+    {
+        flags |= TRACE_INDEX;
+        memcpy(out + size, &after.addressI, 2);
+        size += 2;
+    }
+
+    // Only FX33 and FX55 store to memory, both starting at the old I
+    uint8_t length = 0;
+    if ((opcode & 0xF0FF) == 0xF033)
+        length = 3;
+    else if ((opcode & 0xF0FF) == 0xF055)
+        length = ((opcode >> 8) & 0xF) + 1;
+
+    if (length > 0)
+    {
+        flags |= TRACE_MEMORY;
+
+        uint16_t address = before.addressI & 0xFFF;
+        memcpy(out + size, &address, 2);
+        out[size + 2] = length;
+        size += 3;
+
+        for (int i = 0; i < length; i++)
+            out[size++] = after.memory[(address + i) & 0xFFF];
+    }
+
+    if (before.stackPointer != after.stackPointer)
+    {
+        flags |= TRACE_STACK;
+        out[size++] = after.stackPointer;
+    }
+
+    if (before.delayTimer != after.delayTimer || before.soundTimer != after.soundTimer)
+    {
+        flags |= TRACE_TIMERS;
+        out[size++] = after.delayTimer;
+        out[size++] = after.soundTimer;
+    }
+
+    if (fault != TraceFault::None)
+        out[size++] = (uint8_t)fault;
+
+    out[0] = flags;
+    return size;
+}
+
+void TraceRecorder::Submit()
+{
+    if (m_Used == 0)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    // Recording may not run away from the disk, memory stays bounded
+    m_Drained.wait(lock, [&] { return m_Pending.size() < MAX_PENDING; });
+
+    m_Buffer.resize(m_Used);
+    m_Pending.push_back(std::move(m_Buffer));
+
+    if (!m_Free.empty())
+    {
+        m_Buffer = std::move(m_Free.back());
+        m_Free.pop_back();
+    }
+    else
+        m_Buffer = std::vector<uint8_t>();
+
+    m_Buffer.resize(BUFFER_SIZE);
+    m_Used = 0;
+
+    lock.unlock();
+    m_Wake.notify_one();
+}
+
+void TraceRecorder::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    for (;;)
+    {
+        m_Wake.wait(lock, [&] { return m_Stopping || !m_Pending.empty(); });
+
+        if (m_Pending.empty())
+            break;
+
+        std::vector<uint8_t> buffer = std::move(m_Pending.front());
+        m_Pending.pop_front();
+
+        lock.unlock();
+        fwrite(buffer.data(), 1, buffer.size(), m_File);
+        lock.lock();
+
+        m_Free.push_back(std::move(buffer));
+        m_Drained.notify_one();
+    }
+}
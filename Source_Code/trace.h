@@ -0,0 +1,150 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chip8.h"
+
+/*
+// Execution trace
+//
+// Records every executed instruction as its PC, opcode and the registers,
+// I, memory, stack pointer and timers it changed, in a compact binary
+// encoding (about 8 bytes for a typical ALU instruction). Replaces the
+// #define DEBUG prints, which slow emulation down by orders of magnitude.
+//
+// Ring mode keeps the last N instructions in memory and writes them out on
+// the first fault (unknown opcode, stack overflow or underflow) or on Dump().
+// Stream mode hands full buffers to a background thread that writes the
+// whole run to disk. chip8_tracedump turns either file into text.
+//
+// File format, host byte order:
+//     char     magic[4]        "C8TR"
+//     uint16_t version
+//     uint16_t headerSize
+//     uint64_t first          index of the first recorded instruction
+//   then one record per instruction:
+//     uint8_t  flags          TRACE_* below
+//     uint16_t pc
+//     uint16_t opcode
+//     [uint16_t mask, uint8_t value per set bit]      TRACE_REGISTERS
+//     [uint16_t I]                                    TRACE_INDEX
+//     [uint16_t address, uint8_t length, bytes]       TRACE_MEMORY
+//     [uint8_t stackPointer]                          TRACE_STACK
+//     [uint8_t delayTimer, uint8_t soundTimer]        TRACE_TIMERS
+//     [uint8_t fault]                                 TRACE_FAULT
+*/
+
+enum TraceFlags : uint8_t
+{
+    TRACE_REGISTERS = 0x01,
+    TRACE_INDEX     = 0x02,
+    TRACE_MEMORY    = 0x04,
+    TRACE_STACK     = 0x08,
+    TRACE_TIMERS    = 0x10,
+    TRACE_FAULT     = 0x80
+};
+
+enum class TraceFault : uint8_t
+{
+    None,
+    UnknownOpcode,
+    StackOverflow,
+    StackUnderflow
+};
+
+struct TraceHeader
+{
+    char     magic[4];
+    uint16_t version;
+    uint16_t headerSize;
+    uint64_t first;
+};
+
+static_assert(sizeof(TraceHeader) == 16, "TraceHeader is written as is");
+
+const char* TraceFaultName(TraceFault fault);
+
+// What an instruction may change, captured before it executes
+struct TraceBefore
+{
+    uint8_t  registers[16];
+    uint16_t addressI;
+    uint8_t  stackPointer;
+    uint8_t  delayTimer;
+    uint8_t  soundTimer;
+};
+
+class TraceRecorder
+{
+public:
+    static const uint16_t VERSION = 1;
+
+    // Largest record: all registers, I, 16 bytes of memory, stack, timers and a fault
+    static const size_t MAX_RECORD = 5 + 18 + 2 + 19 + 1 + 2 + 1;
+
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    // Keeps the last instructions in memory, the first fault dumps them to faultFile
+    void StartRing(size_t instructions, const std::string& faultFile = "");
+
+    // Writes every instruction to the file from a background thread
+    bool StartStream(const std::string& fileName);
+
+    // Flushes and closes a stream, a ring keeps its contents for Dump()
+    void Stop();
+
+    // Writes the ring, oldest instruction first
+    bool Dump(const std::string& fileName);
+
+    bool isRecording();
+    uint64_t getInstructions();
+    uint64_t getFaults();
+
+    // Called by chip8 around every instruction while the recorder is attached
+    void Record(uint16_t pc, uint16_t opcode, const TraceBefore& before, const chip8State& after, TraceFault fault);
+
+private:
+    enum class Mode { Off, Ring, Stream };
+
+    Mode m_Mode;
+    uint64_t m_Instructions;
+    uint64_t m_Faults;
+
+    // Ring: fixed size slots, the first byte of each is the record length
+    static const size_t SLOT = MAX_RECORD + 1;
+
+    std::vector<uint8_t> m_Ring;
+    size_t m_Slots;
+    size_t m_Next;
+    std::string m_FaultFile;
+    bool m_Dumped;
+
+    // Stream: the recording thread fills m_Buffer, the writer drains m_Pending
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    FILE* m_File;
+    std::vector<uint8_t> m_Buffer;      // always BUFFER_SIZE long until submitted
+    size_t m_Used;
+    std::deque<std::vector<uint8_t>> m_Pending;
+    std::vector<std::vector<uint8_t>> m_Free;
+    std::mutex m_Lock;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Drained;
+    std::thread m_Writer;
+    bool m_Stopping;
+
+private:
+    static size_t Encode(uint8_t* out, uint16_t pc, uint16_t opcode, const TraceBefore& before, const chip8State& after, TraceFault fault);
+
+    void Submit();
+    void WriterLoop();
+};
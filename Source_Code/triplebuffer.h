@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+// Triple buffer
+//
+// Hands the newest value from one writer thread to one reader thread
+// without locks. The writer fills the back slot and publishes it by
+// swapping it with the middle one, the reader swaps its front slot with the
+// middle one whenever that holds something new. Neither side ever waits,
+// the writer simply replaces a value the reader did not pick up in time.
+//
+// The back slot still holds an old value when the writer gets it, so every
+// publish has to write all of it.
+*/
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : m_Slots(), m_Middle(1)
+    {
+        m_Back = 0;
+        m_Front = 2;
+    }
+
+    // Writer thread only
+    T& getBack()
+    {
+        return m_Slots[m_Back];
+    }
+
+    void Publish()
+    {
+        m_Back = m_Middle.exchange(m_Back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // False while the reader did not take the last published value yet,
+    // a writer faster than the reader can skip filling values nobody sees
+    bool isTaken()
+    {
+        return !(m_Middle.load(std::memory_order_relaxed) & FRESH);
+    }
+
+    // Reader thread only, true if a newer value than the current front was taken
+    bool Update()
+    {
+        if (!(m_Middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+
+        m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T& getFront()
+    {
+        return m_Slots[m_Front];
+    }
+
+private:
+    static const uint8_t INDEX = 0x3;
+    static const uint8_t FRESH = 0x4;
+
+    T m_Slots[3];
+
+    // Slot index, FRESH while the writer published something the reader did not take
+    alignas(64) std::atomic<uint8_t> m_Middle;
+
+    // Each owned by one side
+    alignas(64) uint8_t m_Back;
+    alignas(64) uint8_t m_Front;
+};